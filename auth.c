@@ -18,58 +18,123 @@ static nfs_client * auth_get_client_internal(const char *hname, int *spec);
 static void auth_check_wildcards(nfs_client *cp);
 static void auth_add_mountlist(nfs_client *, nfs_mount *, int);
 static void auth_sort_mountlist(nfs_mount *);
+static void auth_compile_mounts(nfs_client *);
+static void auth_free_mtree(struct nfs_mnode *);
 static void auth_create_hashent(nfs_client *, struct in_addr);
+static void auth_cache_client(nfs_client *, struct in_addr);
 static void auth_hash_host(nfs_client *, struct hostent *);
-static void auth_unhash_host(nfs_client *);
 static void auth_free_list(nfs_client **);
 static void auth_warn_anon(void);
 static void auth_log_clients(nfs_client *cp);
-#ifdef HAVE_INNETGR
-static int  auth_match_netgroup(const char *netgroup, const char *hostname);
-#endif
 static struct hostent * auth_reverse_lookup(struct in_addr);
 static struct hostent * auth_forward_lookup(const char *);
 
 /*
- * It appears to be an old and long-standing tradition on Unices not
- * to declare the netgroup functions in any header file.
- * Glibc departs from that tradition, but I'm too lazy to devise an
- * autoconf test for that...
+ * Client addresses are kept in a hash table that doubles in size
+ * whenever it holds more entries than it has buckets. Addresses named
+ * in the exports file, or belonging to hosts that matched a wildcard,
+ * netgroup or netmask, stay in the table until the exports are
+ * reloaded. Addresses that got the anonymous or default client, or
+ * no client at all, are only cached; there are at most IPCACHEMAX of
+ * those, and the least recently used one makes room for a new one.
  */
-#if defined(HAVE_INNETGR) && !defined(__GLIBC__)
-extern int  innetgr(const char *netgroup, const char *host,
-		    const char *user, const char *domain);
-#endif
-
-#define IPHASH(a)	(((a)^((a)>>8)^((a)>>16)^((a)>>24)) & (IPHASHMAX-1))
-#define IPHASHMAX	32
-#define IPCACHEMAX	16
+#define IPHASH(a)	((ntohl(a) * 2654435761U) >> (32 - hashbits))
+#define IPHASHBITS	6			/* 64 buckets to start	*/
+#define IPCACHEMAX	4096
 
 typedef struct nfs_hash_ent {
 	struct nfs_hash_ent *	next;
+	struct nfs_hash_ent *	lru_next;	/* cached entries only */
+	struct nfs_hash_ent *	lru_prev;
 	struct in_addr		addr;
-	nfs_client *		client;
+	nfs_client *		client;		/* NULL: no access */
+	int			cached;
 } nfs_hash_ent;
 
-typedef struct nfs_cache_ent {
-	struct in_addr		addr;
-	nfs_client *		client;
-} nfs_cache_ent;
+static void auth_lru_unlink(nfs_hash_ent *);
+static void auth_lru_insert(nfs_hash_ent *);
+static void auth_delete_hashent(nfs_hash_ent *);
+
+/*
+ * Netmask clients are kept in a binary tree indexed by address bits,
+ * each client sitting at the depth given by its prefix length, so an
+ * address finds all netmasks that cover it in at most 32 steps.
+ * Masks that aren't contiguous don't fit in there; they are few, and
+ * are checked one by one.
+ */
+typedef struct nfs_nmnode {
+	struct nfs_nmnode *	kids[2];
+	int			nclients;
+	nfs_client **		clients;
+} nfs_nmnode;
+
+#define MASK_CONTIGUOUS(m) \
+	(((~(unsigned long) (m) & 0xffffffffUL) \
+	  & ((~(unsigned long) (m) & 0xffffffffUL) + 1)) == 0)
+
+static nfs_client *auth_check_netmasks(nfs_client *, struct in_addr,
+					const char *, struct hostent *);
+static void auth_free_nmtree(nfs_nmnode *);
 
-static nfs_hash_ent *		hashtable[IPHASHMAX];
+/*
+ * A client's mount points are also kept in a tree with one node per
+ * path component, so that finding the mount point of a path takes
+ * one step per component instead of a strncmp per mount point.
+ */
+typedef struct nfs_mnode {
+	char *			name;
+	nfs_mount *		mount;		/* mount point here, if any */
+	int			nkids;
+	struct nfs_mnode **	kids;		/* sorted by name */
+} nfs_mnode;
+
+/*
+ * Wildcard clients are indexed by the literal tail of their pattern,
+ * i.e. what follows the last wildcard character (".cs.foo.edu" for
+ * *.cs.foo.edu). The hash of a tail is taken from its end, so hashing
+ * a host name from right to left yields the hashes of all its tails
+ * in one pass, and only patterns whose tail ends the name go through
+ * hostmatch. Patterns that end in a wildcard are checked one by one.
+ */
+typedef struct nfs_wcent {
+	struct nfs_wcent *	next;
+	nfs_client *		client;
+	unsigned int		hash;
+	int			taillen;
+	const char *		tail;
+} nfs_wcent;
+
+#define WCHASH(h, c)	((h) * 31 + tolower((unsigned char) (c)))
+
+static int  auth_match_wildcards(const char *, nfs_wcent ***);
+static void auth_free_wcindex(void);
+
+static nfs_hash_ent **		hashtable = NULL;
+static unsigned int		hashbits = 0;
+static unsigned int		hashcount = 0;
+static nfs_hash_ent *		lru_head = NULL;	/* cached entries, */
+static nfs_hash_ent *		lru_tail = NULL;	/* most recent first */
+static unsigned int		lru_count = 0;
 static nfs_client *		known_clients = NULL;
 static nfs_client *		unknown_clients = NULL;
 static nfs_client *		wildcard_clients = NULL;
 static nfs_client *		netgroup_clients = NULL;
 static nfs_client *		netmask_clients = NULL;
+static nfs_nmnode *		netmask_tree = NULL;
+static int			netmask_odd = 0;	/* non-contiguous */
+static nfs_mnode *		export_tree = NULL;	/* all mount points */
+static nfs_wcent **		wc_hash = NULL;
+static unsigned int		wc_hashsize = 0;
+static nfs_wcent *		wc_odd = NULL;		/* no literal tail */
+static nfs_wcent *		wc_ents = NULL;		/* wildcard_clients order */
+static int			wc_count = 0;
 static nfs_client *		anonymous_client = NULL;
 static nfs_client *		default_client = NULL;
-static unsigned int		nr_anonymous_clients = 0;
 static int			initialized = 0;
 
-/* We cache the results of the most recent client lookups */
-static nfs_cache_ent		cached_clients[IPCACHEMAX];
-static int			cached_next = 0;
+/* Set when a client couldn't be looked up because we're still waiting
+ * for its host name */
+int				auth_clnt_pending = 0;
 
 /*
  * Mount options for the public export
@@ -84,6 +149,7 @@ static nfs_options		default_options = {
 					0,		/* relative links */
 					0,		/* noaccess */
 					1,		/* cross_mounts */
+					0,		/* async */
 					(uid_t)-2,	/* default uid */
 					(gid_t)-2,	/* default gid */
 					0,		/* no NIS domain */
@@ -99,6 +165,7 @@ static nfs_options		anonymous_options = {
 					0,		/* relative links */
 					0,		/* noaccess */
 					1,		/* cross_mounts */
+					0,		/* async */
 					(uid_t)-2,	/* default uid */
 					(gid_t)-2,	/* default gid */
 					0,		/* no NIS domain */
@@ -154,7 +221,7 @@ auth_atob(const char *name, struct in_addr *ap)
 		m = m * 10 + (unsigned char) *name - '0';
 	if (m > 32)
 		return 0;
-	ap->s_addr = m ? ~((1 << (32 - m)) - 1) : 0;
+	ap->s_addr = htonl(m ? ~((1UL << (32 - m)) - 1) : 0);
 	return 1;
 }
 
@@ -246,38 +313,208 @@ auth_get_client_internal(const char *hname, int *special)
 }
 
 /*
- * Given a client and a pathname, try to find the proper mount point.
- * This code relies on the mount list being sorted from largest to
- * smallest w.r.t strcmp.
+ * Find the next component of a path. Returns NULL at the end.
+ */
+static inline const char *
+auth_path_comp(const char *path, const char *end, int *len)
+{
+	const char	*sp;
+
+	while (path < end && *path == '/')
+		path++;
+	for (sp = path; sp < end && *sp != '/'; sp++)
+		;
+	*len = sp - path;
+	return *len? path : NULL;
+}
+
+/*
+ * Find the child of a mount tree node with the given name. If there
+ * is none, *pos is where it would go.
+ */
+static nfs_mnode *
+auth_mnode_find(nfs_mnode *np, const char *name, int len, int *pos)
+{
+	nfs_mnode	*kp;
+	int		lo = 0, hi = np->nkids, mid, cmp;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		kp = np->kids[mid];
+		if ((cmp = strncmp(kp->name, name, len)) == 0
+		 && kp->name[len] != '\0')
+			cmp = 1;
+		if (cmp == 0)
+			return kp;
+		if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*pos = lo;
+	return NULL;
+}
+
+static nfs_mnode *
+auth_mnode_new(const char *name, int len)
+{
+	nfs_mnode	*np;
+
+	np = (nfs_mnode *) xmalloc(sizeof(*np));
+	np->name = (char *) xmalloc(len + 1);
+	memcpy(np->name, name, len);
+	np->name[len] = '\0';
+	np->mount = NULL;
+	np->nkids = 0;
+	np->kids = NULL;
+	return np;
+}
+
+/*
+ * Find the node for a mount point, adding it to the tree if needed.
+ */
+static nfs_mnode *
+auth_mtree_add(nfs_mnode *np, nfs_mount *mp)
+{
+	nfs_mnode	*kp;
+	const char	*sp, *end;
+	int		len, pos;
+
+	end = mp->path + mp->length;
+	for (sp = mp->path; (sp = auth_path_comp(sp, end, &len)); sp += len) {
+		if ((kp = auth_mnode_find(np, sp, len, &pos)) == NULL) {
+			kp = auth_mnode_new(sp, len);
+			np->kids = (nfs_mnode **) xrealloc(np->kids,
+				(np->nkids + 1) * sizeof(nfs_mnode *));
+			memmove(np->kids + pos + 1, np->kids + pos,
+				(np->nkids - pos) * sizeof(nfs_mnode *));
+			np->kids[pos] = kp;
+			np->nkids++;
+		}
+		np = kp;
+	}
+	return np;
+}
+
+/*
+ * Build a client's mount tree from its mount list. Where the list
+ * has the same path twice, the first entry wins, as it did when we
+ * searched the list itself.
+ */
+static void
+auth_compile_mounts(nfs_client *cp)
+{
+	nfs_mnode	*np;
+	nfs_mount	*mp;
+
+	auth_free_mtree(cp->mtree);
+	cp->mtree = auth_mnode_new("", 0);
+	for (mp = cp->m; mp != NULL; mp = mp->next) {
+		np = auth_mtree_add(cp->mtree, mp);
+		if (np->mount == NULL)
+			np->mount = mp;
+	}
+}
+
+static void
+auth_free_mtree(nfs_mnode *np)
+{
+	int	i;
+
+	if (np == NULL)
+		return;
+	for (i = 0; i < np->nkids; i++)
+		auth_free_mtree(np->kids[i]);
+	if (np->kids)
+		free(np->kids);
+	free(np->name);
+	free(np);
+}
+
+/*
+ * Given a client and a pathname, try to find the proper mount point,
+ * i.e. the one with the longest path that is a prefix of pathname.
+ * The mount tree is built when first needed after the mount list
+ * has changed.
  */
 nfs_mount *
 auth_match_mount(nfs_client *cp, char *path)
 {
+	nfs_mnode	*np;
 	nfs_mount	*mp;
-	char		c;
+	const char	*sp, *end;
+	int		len, pos;
 
-	if (path == NULL)
+	if (path == NULL || cp->m == NULL)
 		return NULL;
+	if (cp->mtree == NULL)
+		auth_compile_mounts(cp);
+
+	np = cp->mtree;
+	mp = np->mount;
+	end = path + strlen(path);
+	for (sp = path; (sp = auth_path_comp(sp, end, &len)); sp += len) {
+		if ((np = auth_mnode_find(np, sp, len, &pos)) == NULL)
+			break;
+		if (np->mount != NULL)
+			mp = np->mount;
+	}
+	return mp;
+}
 
-	for (mp = cp->m; mp != NULL; mp = mp->next) {
-		if (!strncmp(mp->path, path, mp->length) &&
-		    ((c = path[mp->length]) == '/' || c == '\0')) {
-			return mp;
+/*
+ * Is the path at or below a mount point of any client? The tree of
+ * all mount points is built when first needed after a reload.
+ */
+int
+auth_exported(const char *path)
+{
+	static nfs_client	**lists[] = {
+		&known_clients, &unknown_clients, &wildcard_clients,
+		&netgroup_clients, &netmask_clients, &anonymous_client,
+		&default_client, NULL
+	};
+	nfs_client		*cp, ***lp;
+	nfs_mount		*mp;
+	nfs_mnode		*np;
+	const char		*sp, *end;
+	int			len, pos;
+
+	if (export_tree == NULL) {
+		export_tree = auth_mnode_new("", 0);
+		for (lp = lists; *lp != NULL; lp++) {
+			for (cp = **lp; cp != NULL; cp = cp->next) {
+				for (mp = cp->m; mp != NULL; mp = mp->next) {
+					np = auth_mtree_add(export_tree, mp);
+					if (np->mount == NULL)
+						np->mount = mp;
+				}
+			}
 		}
 	}
-	return NULL;
+
+	np = export_tree;
+	end = path + strlen(path);
+	for (sp = path; np->mount == NULL; sp += len) {
+		if ((sp = auth_path_comp(sp, end, &len)) == NULL
+		 || (np = auth_mnode_find(np, sp, len, &pos)) == NULL)
+			return 0;
+	}
+	return 1;
 }
 
 /*
- * Find a known client given its IP address.
+ * Find the hash entry for an IP address.
  * The matching hash entry is moved to the list head. This may be useful
  * for sites with large exports list (e.g. due to huge netgroups).
  */
-nfs_client *
-auth_known_clientbyaddr(struct in_addr addr)
+static nfs_hash_ent *
+auth_hash_lookup(struct in_addr addr)
 {
 	nfs_hash_ent	**htp, *hep, *prv;
 
+	if (hashtable == NULL)
+		return NULL;
 	htp = hashtable + IPHASH(addr.s_addr);
 	hep = *htp;
 	for (prv = NULL; hep != NULL; prv = hep, hep = hep->next) {
@@ -287,13 +524,26 @@ auth_known_clientbyaddr(struct in_addr addr)
 				hep->next = *htp;
 				*htp = hep;
 			}
-			hep->client->clnt_addr = addr;
-			return hep->client;
+			return hep;
 		}
 	}
 	return NULL;
 }
 
+/*
+ * Find a known client given its IP address.
+ */
+nfs_client *
+auth_known_clientbyaddr(struct in_addr addr)
+{
+	nfs_hash_ent	*hep;
+
+	if ((hep = auth_hash_lookup(addr)) == NULL || hep->cached)
+		return NULL;
+	hep->client->clnt_addr = addr;
+	return hep->client;
+}
+
 /*
  * Find a known client given its FQDN.
  */
@@ -318,101 +568,18 @@ auth_known_clientbyname(char *hname)
 static struct hostent *
 auth_reverse_lookup(struct in_addr addr)
 {
-	struct hostent	*hp;
-	char		nambuf[256];
-	char		**ap;
-
-	hp = gethostbyaddr((char *) &addr, sizeof(addr), AF_INET);
-
-	Dprintf(D_AUTH, "auth_reverse_lookup(%s) %s\n",
-		inet_ntoa(addr), hp? hp->h_name : "[FAIL]");
-
-	if (hp != NULL) {
-		const char	*n = hp->h_name;
-		int		i;
-
-		/* Keep temp copy of hostname. We must take care
-		 * of trailing white space because some NIS servers
-		 * put it into their maps, and libc doesn't remove it.
-		 */
-		for (i = 0; *n && i < sizeof(nambuf)-1; i++, n++) {
-			if (*n == ' ' || *n == '\t')
-				break;
-			nambuf[i] = *n;
-		}
-		nambuf[i] = '\0';
-
-		/*
-		 * Do a forward lookup
-		 * (FIXME: resolver lib may already have done this).
-		 */
-		hp = gethostbyname(nambuf);
-		if (hp == NULL) {
-			Dprintf(L_ERROR,
-				"couldn't verify address of host %s\n",
-				inet_ntoa(addr));
-			return NULL;
-		}
-		if (hp->h_addrtype != AF_INET) {
-			Dprintf(L_WARNING,
-				"%s has address type %d != AF_INET.\n",
-				inet_ntoa(addr), hp->h_addrtype);
-			return NULL;
-		}
-		if (hp->h_length != 4) {
-			Dprintf(L_WARNING,
-				"%s has address length %d != 4.\n",
-				inet_ntoa(addr), hp->h_length);
-			return NULL;
-		}
-
-		/*
-		 * Make sure this isn't a spoof attempt.
-		 */
-		for (ap = hp->h_addr_list; *ap != NULL; ap++) {
-			if (!memcmp(*ap, &addr, hp->h_length))
-				break;
-		}
+	int	pending;
 
-		if (*ap == NULL) {
-			Dprintf(L_ERROR,
-				"spoof attempt by %s: pretends to be %s!\n",
-				inet_ntoa(addr), hp->h_name);
-			return NULL;
-		}
-	}
-
-	return hp;
+	return auth_dns_lookup(addr, 0, &pending);
 }
 
 /*
- * Perform a forward lookup on a hostname, with checks
+ * Perform a forward lookup on a hostname
  */
 static struct hostent *
 auth_forward_lookup(const char *hname)
 {
-	struct hostent	*hp;
-
-	hp = gethostbyname(hname);
-
-	Dprintf(D_AUTH, "auth_forward_lookup(%s) %s\n",
-		hname, hp? hp->h_name : "[FAIL]");
-
-	if (hp != NULL) {
-		if (hp->h_addrtype != AF_INET) {
-			Dprintf(L_WARNING,
-				"%s has address type %d != AF_INET.\n",
-				hname, hp->h_addrtype);
-			return NULL;
-		}
-		if (hp->h_length != 4) {
-			Dprintf(L_WARNING,
-				"%s has address length %d != 4.\n",
-				hname, hp->h_length);
-			return NULL;
-		}
-	}
-	return hp;
+	return auth_dns_byname(hname);
 }
 
 /*
@@ -434,11 +601,19 @@ auth_unknown_clientbyaddr(struct in_addr addr)
 	Dprintf(D_AUTH, "check unknown clnt addr %s\n", inet_ntoa(addr));
 
 	/* Don't reverse lookup if never needed */
-	if (unknown_clients || wildcard_clients || netgroup_clients)
-		hp = auth_reverse_lookup(addr);
+	if (unknown_clients || wildcard_clients || netgroup_clients) {
+		hp = auth_dns_lookup(addr, auth_dns_async, &auth_clnt_pending);
+		if (auth_clnt_pending) {
+			Dprintf(D_AUTH, "\tname of %s not known yet\n",
+				inet_ntoa(addr));
+			return NULL;
+		}
+	}
 
 	if (hp != NULL) {
 		nfs_client	**cpp;
+		nfs_wcent	**matches;
+		int		i, n;
 
 		Dprintf(D_AUTH, "\tclient name is %s\n", hp->h_name);
 		hname = hp->h_name;
@@ -480,16 +655,14 @@ auth_unknown_clientbyaddr(struct in_addr addr)
 		 * The pattern matching should also be applied to
 		 * all names in h_aliases.
 		 */
-		for (cpp = &wildcard_clients; (cp = *cpp); cpp = &cp->next) {
-			if (hostmatch(hname, cp->clnt_name)) {
-				Dprintf(D_AUTH,
-					"client %s matched pattern %s\n",
-					hname, cp->clnt_name);
-				if (!ncp)
-					ncp = auth_create_client(hname, hp);
-				auth_add_mountlist(ncp, cp->m, 0);
-				/* continue, loop over all wildcards */
-			}
+		n = auth_match_wildcards(hname, &matches);
+		for (i = 0; i < n; i++) {
+			cp = matches[i]->client;
+			Dprintf(D_AUTH, "client %s matched pattern %s\n",
+				hname, cp->clnt_name);
+			if (!ncp)
+				ncp = auth_create_client(hname, hp);
+			auth_add_mountlist(ncp, cp->m, 0);
 		}
 
 		/*
@@ -497,7 +670,7 @@ auth_unknown_clientbyaddr(struct in_addr addr)
 		 */
 #ifdef HAVE_INNETGR
 		for (cpp = &netgroup_clients; (cp = *cpp); cpp = &cp->next) {
-			if (auth_match_netgroup(cp->clnt_name+1, hname)) {
+			if (auth_netgroup_match(cp->clnt_name+1, hname)) {
 				Dprintf(D_AUTH,
 					"client %s matched netgroup %s\n",
 					hname, cp->clnt_name+1);
@@ -515,16 +688,7 @@ auth_unknown_clientbyaddr(struct in_addr addr)
 	/*
 	 * Final step: check netmask clients
 	 */
-	for (cp = netmask_clients; cp != NULL; cp = cp->next) {
-		if (!((addr.s_addr^cp->clnt_addr.s_addr)&cp->clnt_mask.s_addr)){
-			Dprintf(D_AUTH, "client %s matched %s\n",
-				hname, cp->clnt_name);
-			if (!ncp)
-				ncp = auth_create_client(hname, hp);
-			auth_add_mountlist(ncp, cp->m, 0);
-			/* continue, loop over all netmasks */
-		}
-	}
+	ncp = auth_check_netmasks(ncp, addr, hname, hp);
 
 	if ((cp = anonymous_client) || (cp = default_client)) {
 		if (!ncp) {
@@ -536,12 +700,7 @@ auth_unknown_clientbyaddr(struct in_addr addr)
 			 * its info without duplicating the entry. This
 			 * should streamline operations for anon NFS
 			 * exports. */
-			if (++nr_anonymous_clients > 1000) {
-				auth_unhash_host(anonymous_client);
-				auth_unhash_host(default_client);
-				nr_anonymous_clients = 0;
-			}
-			auth_create_hashent(cp, addr);
+			auth_cache_client(cp, addr);
 			return cp;
 #endif
 		}
@@ -555,34 +714,38 @@ auth_unknown_clientbyaddr(struct in_addr addr)
 
 /*
  * Look up a client by address.
- * We currently maintain a simple round-robin cache of the n most recently
- * resolved addresses. Not sure how much this improves performance, but it
- * may help the anon nfs case.
- *
- * It also implements nicely a negative lookup cache for unknown clients.
+ * Addresses that don't get a client are cached like anonymous ones,
+ * which gives us a negative lookup cache for unknown clients.
  */
 nfs_client *
 auth_clientbyaddr(struct in_addr addr)
 {
+	nfs_hash_ent	*hep;
 	nfs_client	*cp;
-	int		i;
 
-	/* First, look into cache of recent clients */
-	for (i = 0; i < IPCACHEMAX; i++) {
-		if (cached_clients[i].addr.s_addr == addr.s_addr)
-			return cached_clients[i].client;
+#ifdef HAVE_INNETGR
+	/* When a netgroup has a new member list, hosts we turned
+	 * away may be in it now. */
+	if (netgroup_clients != NULL && auth_netgroup_refresh()) {
+		Dprintf(D_AUTH, "netgroups changed, dropping cached clients\n");
+		while (lru_head != NULL)
+			auth_delete_hashent(lru_head);
 	}
+#endif
 
-	/* Check if this is a known host ... */
-	if ((cp = auth_known_clientbyaddr(addr)) == NULL) {
-		/* No, it's not. Check against list of unknown hosts */
-		cp = auth_unknown_clientbyaddr(addr);
+	if ((hep = auth_hash_lookup(addr)) != NULL) {
+		if (hep->cached && hep != lru_head) {
+			auth_lru_unlink(hep);
+			auth_lru_insert(hep);
+		}
+		if ((cp = hep->client) != NULL)
+			cp->clnt_addr = addr;
+		return cp;
 	}
 
-	/* Put in the cache */
-	cached_clients[cached_next].addr   = addr;
-	cached_clients[cached_next].client = cp;
-	cached_next = (cached_next + 1) % IPCACHEMAX;
+	/* No, it's not. Check against list of unknown hosts */
+	if ((cp = auth_unknown_clientbyaddr(addr)) == NULL && !auth_clnt_pending)
+		auth_cache_client(NULL, addr);
 
 	return cp;
 }
@@ -606,6 +769,7 @@ auth_create_client(const char *hname, struct hostent *hp)
 	cp->clnt_addr.s_addr = INADDR_ANY;
 	cp->flags = 0;
 	cp->m = NULL;
+	cp->mtree = NULL;
 	cp->umap = NULL;
 
 	if (hname == NULL) {
@@ -662,6 +826,7 @@ auth_create_client(const char *hname, struct hostent *hp)
 		 */
 		cp->flags = AUTH_CLNT_WILDCARD;
 		cpp = &wildcard_clients;
+		auth_free_wcindex();
 		namelen = strlen(hname);
 		while (*cpp != NULL && namelen <= strlen((*cpp)->clnt_name)) {
 			cpp = &((*cpp)->next);
@@ -670,6 +835,9 @@ auth_create_client(const char *hname, struct hostent *hp)
 		/* Netgroup name. */
 		cp->flags = AUTH_CLNT_NETGROUP;
 		cpp = &netgroup_clients;
+#ifdef HAVE_INNETGR
+		auth_netgroup_load(hname + 1);
+#endif
 	} else if (is_hostaddr) {
 		/* Just an address.
 		 * We deviate slightly from the rule that we should always
@@ -712,6 +880,7 @@ auth_create_default_client(void)
 		cp->next = NULL;
 		cp->flags = AUTH_CLNT_DEFAULT;
 		cp->m = NULL;
+		cp->mtree = NULL;
 		default_client = cp;
 	}
 	auth_warn_anon();
@@ -760,55 +929,132 @@ auth_warn_anon(void)
 }
 
 /*
- * Create an entry in the hashtable of known clients.
+ * Double the size of the hash table.
  */
 static void
-auth_create_hashent(nfs_client *cp, struct in_addr addr)
+auth_hash_grow(void)
+{
+	nfs_hash_ent	**old = hashtable, *hep, *next;
+	unsigned int	i, oldsize = hashbits? 1 << hashbits : 0;
+
+	hashbits = hashbits? hashbits + 1 : IPHASHBITS;
+	hashtable = (nfs_hash_ent **) xmalloc(sizeof(nfs_hash_ent *) << hashbits);
+	memset(hashtable, 0, sizeof(nfs_hash_ent *) << hashbits);
+	for (i = 0; i < oldsize; i++) {
+		for (hep = old[i]; hep != NULL; hep = next) {
+			next = hep->next;
+			hep->next = hashtable[IPHASH(hep->addr.s_addr)];
+			hashtable[IPHASH(hep->addr.s_addr)] = hep;
+		}
+	}
+	if (old != NULL)
+		free(old);
+}
+
+static void
+auth_lru_unlink(nfs_hash_ent *hep)
+{
+	if (hep->lru_prev != NULL)
+		hep->lru_prev->lru_next = hep->lru_next;
+	else
+		lru_head = hep->lru_next;
+	if (hep->lru_next != NULL)
+		hep->lru_next->lru_prev = hep->lru_prev;
+	else
+		lru_tail = hep->lru_prev;
+}
+
+static void
+auth_lru_insert(nfs_hash_ent *hep)
+{
+	hep->lru_prev = NULL;
+	hep->lru_next = lru_head;
+	if (lru_head != NULL)
+		lru_head->lru_prev = hep;
+	else
+		lru_tail = hep;
+	lru_head = hep;
+}
+
+/*
+ * Remove an entry from the hashtable and free it.
+ */
+static void
+auth_delete_hashent(nfs_hash_ent *hep)
+{
+	nfs_hash_ent	**htp;
+
+	for (htp = hashtable + IPHASH(hep->addr.s_addr); *htp != hep; )
+		htp = &(*htp)->next;
+	*htp = hep->next;
+	if (hep->cached) {
+		auth_lru_unlink(hep);
+		lru_count--;
+	}
+	hashcount--;
+	free(hep);
+}
+
+static nfs_hash_ent *
+auth_insert_hashent(nfs_client *cp, struct in_addr addr, int cached)
 {
 	nfs_hash_ent	*hep;
 	int		hash;
 
+	if (hashcount >= (hashbits? 1U << hashbits : 0))
+		auth_hash_grow();
 	hash = IPHASH(addr.s_addr);
 
 	hep = (nfs_hash_ent *) xmalloc(sizeof(*hep));
 	hep->client = cp;
 	hep->addr = addr;
+	hep->cached = cached;
 	hep->next = hashtable[hash];
 	hashtable[hash] = hep;
+	hashcount++;
+	return hep;
 }
 
+/*
+ * Create an entry in the hashtable of known clients. It replaces
+ * whatever we may have cached for this address.
+ */
 static void
-auth_hash_host(nfs_client *cp, struct hostent *hp)
+auth_create_hashent(nfs_client *cp, struct in_addr addr)
 {
-	char	**ap;
+	nfs_hash_ent	*hep;
 
-	for (ap = hp->h_addr_list; *ap != NULL; ap++)
-		auth_create_hashent(cp, *(struct in_addr *) *ap);
+	if ((hep = auth_hash_lookup(addr)) != NULL && hep->cached)
+		auth_delete_hashent(hep);
+	auth_insert_hashent(cp, addr, 0);
 }
 
 /*
- * This is used to unhash the default/anonymous client
+ * Remember the client (or lack of one) for an address that isn't
+ * named in the exports file.
  */
 static void
-auth_unhash_host(nfs_client *cp)
+auth_cache_client(nfs_client *cp, struct in_addr addr)
 {
-	nfs_hash_ent	**epp, *hep;
-	unsigned int	i;
-
-	if (cp == NULL)
-		return;
+	nfs_hash_ent	*hep;
 
-	for (i = 0; i < IPHASHMAX; i++) {
-		epp = hashtable + i;
-		while ((hep = *epp) != 0) {
-			if (hep->client == cp) {
-				*epp = hep->next;
-				free(hep);
-			} else {
-				epp = &hep->next;
-			}
-		}
+	if (lru_count >= IPCACHEMAX) {
+		Dprintf(D_AUTH, "dropping cached client %s\n",
+			inet_ntoa(lru_tail->addr));
+		auth_delete_hashent(lru_tail);
 	}
+	hep = auth_insert_hashent(cp, addr, 1);
+	auth_lru_insert(hep);
+	lru_count++;
+}
+
+static void
+auth_hash_host(nfs_client *cp, struct hostent *hp)
+{
+	char	**ap;
+
+	for (ap = hp->h_addr_list; *ap != NULL; ap++)
+		auth_create_hashent(cp, *(struct in_addr *) *ap);
 }
 
 /*
@@ -833,13 +1079,12 @@ auth_check_all_wildcards(void)
 static void
 auth_check_wildcards(nfs_client *cp)
 {
-	nfs_client	*wcp;
+	nfs_wcent	**matches;
+	int		i, n;
 
-	for (wcp = wildcard_clients; wcp != NULL; wcp = wcp->next) {
-		if (hostmatch(cp->clnt_name, wcp->clnt_name)) {
-			auth_add_mountlist(cp, wcp->m, 0);
-		}
-	}
+	n = auth_match_wildcards(cp->clnt_name, &matches);
+	for (i = 0; i < n; i++)
+		auth_add_mountlist(cp, matches[i]->client->m, 0);
 	if (anonymous_client != NULL) {
 		auth_add_mountlist(cp, anonymous_client->m, 0);
 	}
@@ -859,7 +1104,7 @@ auth_check_all_netgroups(void)
 	for (cp = known_clients; cp != NULL; cp = cp->next) {
 		for (ncp = netgroup_clients; ncp != NULL; ncp = ncp->next) {
 			group = ncp->clnt_name+1;
-			match = auth_match_netgroup(group, cp->clnt_name);
+			match = auth_netgroup_match(group, cp->clnt_name);
 			Dprintf(D_AUTH, "   match %s ~ %s %s\n",
 				cp->clnt_name, group,
 				match? "okay" : "fail");
@@ -870,60 +1115,117 @@ auth_check_all_netgroups(void)
 #endif
 }
 
-#ifdef HAVE_INNETGR
 /*
- * Match a given hostname against a netgroup.
- * Never thought that netgroups could be so complicated...
+ * Put a netmask client into the netmask tree.
  */
-static int
-auth_match_netgroup(const char *netgroup, const char *hostname)
+static void
+auth_netmask_insert(nfs_client *cp)
 {
-	char	*dot;
-	int	match;
+	unsigned long	addr = ntohl(cp->clnt_addr.s_addr);
+	unsigned long	mask = ntohl(cp->clnt_mask.s_addr);
+	nfs_nmnode	**npp = &netmask_tree, *np;
+	int		bit;
 
-	/* First, try to match the hostname without splitting 
-	 * off the domain */
-	if (innetgr(netgroup, hostname, NULL, NULL))
-		return 1;
+	if (!MASK_CONTIGUOUS(mask)) {
+		netmask_odd++;
+		return;
+	}
+	for (bit = 31; ; bit--) {
+		if ((np = *npp) == NULL) {
+			np = *npp = (nfs_nmnode *) xmalloc(sizeof(*np));
+			memset(np, 0, sizeof(*np));
+		}
+		if (bit < 0 || !(mask & (1UL << bit)))
+			break;
+		npp = &np->kids[(addr >> bit) & 1];
+	}
+	np->clients = (nfs_client **) xrealloc(np->clients,
+				(np->nclients + 1) * sizeof(nfs_client *));
+	np->clients[np->nclients++] = cp;
+}
 
-	/* Okay, strip off the domain (if we have one) */
-	if ((dot = strchr(hostname, '.')) == NULL)
-		return 0;
+static void
+auth_free_nmtree(nfs_nmnode *np)
+{
+	if (np == NULL)
+		return;
+	auth_free_nmtree(np->kids[0]);
+	auth_free_nmtree(np->kids[1]);
+	if (np->clients)
+		free(np->clients);
+	free(np);
+}
 
-	*dot = '\0';
-	match = innetgr(netgroup, hostname, NULL, dot + 1);
-	*dot = '.';
+static nfs_client *
+auth_netmask_match(nfs_client *ncp, nfs_client *cp, const char *hname,
+					struct hostent *hp)
+{
+	Dprintf(D_AUTH, "client %s matched %s\n", hname, cp->clnt_name);
+	if (!ncp)
+		ncp = auth_create_client(hname, hp);
+	auth_add_mountlist(ncp, cp->m, 0);
+	return ncp;
+}
+
+/*
+ * Add the mount points of all netmask clients covering addr to ncp,
+ * most specific netmask first. If ncp is NULL, it is created on the
+ * first match.
+ */
+static nfs_client *
+auth_check_netmasks(nfs_client *ncp, struct in_addr addr, const char *hname,
+					struct hostent *hp)
+{
+	unsigned long	a = ntohl(addr.s_addr);
+	nfs_nmnode	*path[33], *np;
+	nfs_client	*cp;
+	int		bit, depth = 0, i;
+
+	for (np = netmask_tree, bit = 31; np != NULL; bit--) {
+		if (np->nclients)
+			path[depth++] = np;
+		if (bit < 0)
+			break;
+		np = np->kids[(a >> bit) & 1];
+	}
+	while (depth--) {
+		np = path[depth];
+		for (i = 0; i < np->nclients; i++)
+			ncp = auth_netmask_match(ncp, np->clients[i], hname, hp);
+	}
 
-	return match;
+	if (netmask_odd) {
+		for (cp = netmask_clients; cp != NULL; cp = cp->next) {
+			if (!MASK_CONTIGUOUS(ntohl(cp->clnt_mask.s_addr))
+			 && !((addr.s_addr ^ cp->clnt_addr.s_addr)
+			      & cp->clnt_mask.s_addr))
+				ncp = auth_netmask_match(ncp, cp, hname, hp);
+		}
+	}
+	return ncp;
 }
-#endif /* HAVE_INNETGR */
 
 /*
- * Check all client structs that match an addr/mask pair
+ * Build the netmask tree, and check all client structs that match
+ * an addr/mask pair
  */
 void
 auth_check_all_netmasks(void)
 {
-	nfs_client	*ncp, *cp;
+	nfs_client	*cp;
 	nfs_hash_ent	*hp;
-	int		i, match;
-
-	for (ncp = netmask_clients; ncp != NULL; ncp = ncp->next) {
-		for (i = 0; i < IPHASHMAX; i++) {
-			for (hp = hashtable[i]; hp != NULL; hp = hp->next) {
-				match = ((hp->addr.s_addr 
-				        ^ ncp->clnt_addr.s_addr)
-			                & ncp->clnt_mask.s_addr) == 0;
-				Dprintf(D_AUTH,
-					"   match %s ~ %s %s\n",
-					inet_ntoa(hp->addr),
-					ncp->clnt_name,
-					match? "okay" : "fail");
-				if (match) {
-					cp = hp->client;
-					auth_add_mountlist(cp, ncp->m, 0);
-				}
-			}
+	unsigned int	i;
+
+	for (cp = netmask_clients; cp != NULL; cp = cp->next)
+		auth_netmask_insert(cp);
+
+	if (hashtable == NULL || netmask_clients == NULL)
+		return;
+	for (i = 0; i < (1U << hashbits); i++) {
+		for (hp = hashtable[i]; hp != NULL; hp = hp->next) {
+			if (!hp->cached)
+				auth_check_netmasks(hp->client, hp->addr,
+						inet_ntoa(hp->addr), NULL);
 		}
 	}
 }
@@ -961,10 +1263,11 @@ auth_log_clients(nfs_client *cp)
 			if (mp->origin != cp)
 				Dprintf(D_AUTH, "\t\torigin:  %s\n",
 					mp->origin->clnt_name);
-			Dprintf(D_AUTH, "\t\toptions:%s%s%s\n",
+			Dprintf(D_AUTH, "\t\toptions:%s%s%s%s\n",
 				mp->o.read_only?   " ro" : " rw",
 				mp->o.root_squash? " noroot" : "",
-				mp->o.secure_port? " portck" : "");
+				mp->o.secure_port? " portck" : "",
+				mp->o.async?       " async" : "");
 		}
 		cp = cp->next;
 	}
@@ -982,6 +1285,12 @@ auth_add_mount(nfs_client *cp, char *path, int override)
 
 	len = strlen(path);
 
+	/* The mount trees have to be rebuilt */
+	auth_free_mtree(cp->mtree);
+	cp->mtree = NULL;
+	auth_free_mtree(export_tree);
+	export_tree = NULL;
+
 	/* Locate position of mount point in list of mount.
 	 * Insert more specific path before less specific path.
 	 *
@@ -1067,15 +1376,128 @@ auth_sort_mountlist(nfs_mount *mp)
 }
 
 /*
- * Sort all mount lists
+ * Sort all mount lists, and build the mount trees of known clients
  */
 void
 auth_sort_all_mountlists()
 {
 	nfs_client	*cp;
 
-	for (cp = known_clients; cp != NULL; cp = cp->next)
+	for (cp = known_clients; cp != NULL; cp = cp->next) {
 		auth_sort_mountlist(cp->m);
+		if (cp->m != NULL)
+			auth_compile_mounts(cp);
+	}
+}
+
+/*
+ * Build the index of wildcard patterns.
+ */
+static void
+auth_build_wcindex(void)
+{
+	nfs_client	*cp;
+	nfs_wcent	*wp;
+	const char	*sp, *tail;
+	unsigned int	h;
+	int		i, n = 0;
+
+	for (cp = wildcard_clients; cp != NULL; cp = cp->next)
+		n++;
+	wc_ents = (nfs_wcent *) xmalloc(n * sizeof(nfs_wcent) + 1);
+	for (wc_hashsize = 16; wc_hashsize < 2 * n; wc_hashsize <<= 1)
+		;
+	wc_hash = (nfs_wcent **) xmalloc(wc_hashsize * sizeof(nfs_wcent *));
+	memset(wc_hash, 0, wc_hashsize * sizeof(nfs_wcent *));
+
+	for (cp = wildcard_clients, wp = wc_ents; cp; cp = cp->next, wp++) {
+		for (sp = tail = cp->clnt_name; *sp; sp++) {
+			if (*sp == '*' || *sp == '?')
+				tail = sp + 1;
+		}
+		wp->client = cp;
+		wp->tail = tail;
+		wp->taillen = strlen(tail);
+		for (h = 0, i = wp->taillen; i-- > 0; )
+			h = WCHASH(h, tail[i]);
+		wp->hash = h;
+		if (wp->taillen == 0) {
+			wp->next = wc_odd;
+			wc_odd = wp;
+		} else {
+			wp->next = wc_hash[h & (wc_hashsize - 1)];
+			wc_hash[h & (wc_hashsize - 1)] = wp;
+		}
+	}
+	wc_count = n;
+}
+
+static void
+auth_free_wcindex(void)
+{
+	if (wc_ents != NULL)
+		free(wc_ents);
+	if (wc_hash != NULL)
+		free(wc_hash);
+	wc_ents = wc_odd = NULL;
+	wc_hash = NULL;
+	wc_hashsize = 0;
+	wc_count = 0;
+}
+
+/*
+ * Add a pattern that matches to the list, keeping the list in the
+ * order of wildcard_clients.
+ */
+static void
+auth_wcmatch(nfs_wcent *wp, const char *hname, nfs_wcent **matches, int *n)
+{
+	int	i;
+
+	if (!hostmatch(hname, wp->client->clnt_name))
+		return;
+	for (i = (*n)++; i > 0 && matches[i-1] > wp; i--)
+		matches[i] = matches[i-1];
+	matches[i] = wp;
+}
+
+/*
+ * Find all wildcard clients matching a host name, most specific first.
+ * The array returned is good until the next call.
+ */
+static int
+auth_match_wildcards(const char *hname, nfs_wcent ***result)
+{
+	static nfs_wcent	**matches = NULL;
+	static int		size = 0;
+	nfs_wcent		*wp;
+	unsigned int		h = 0;
+	int			len, i, n = 0;
+
+	if (wildcard_clients == NULL)
+		return 0;
+	if (wc_ents == NULL)
+		auth_build_wcindex();
+	if (size < wc_count) {
+		size = wc_count;
+		matches = (nfs_wcent **) xrealloc(matches,
+					size * sizeof(nfs_wcent *));
+	}
+
+	len = strlen(hname);
+	for (i = len; i-- > 0; ) {
+		h = WCHASH(h, hname[i]);
+		for (wp = wc_hash[h & (wc_hashsize - 1)]; wp; wp = wp->next) {
+			if (wp->hash == h && wp->taillen == len - i
+			 && !strcasecmp(wp->tail, hname + i))
+				auth_wcmatch(wp, hname, matches, &n);
+		}
+	}
+	for (wp = wc_odd; wp != NULL; wp = wp->next)
+		auth_wcmatch(wp, hname, matches, &n);
+
+	*result = matches;
+	return n;
 }
 
 /*
@@ -1128,7 +1550,7 @@ void
 auth_init_lists(void)
 {
 	struct passwd	*pw;
-	int		i;
+	unsigned int	i;
 	uid_t		anon_uid;
 	gid_t		anon_gid;
 
@@ -1138,22 +1560,34 @@ auth_init_lists(void)
 		auth_free_list(&known_clients);
 		auth_free_list(&unknown_clients);
 		auth_free_list(&wildcard_clients);
+		auth_free_wcindex();
 		auth_free_list(&netgroup_clients);
+#ifdef HAVE_INNETGR
+		auth_netgroup_clear();
+#endif
+		auth_free_list(&netmask_clients);
 		auth_free_list(&anonymous_client);
 		auth_free_list(&default_client);
+		auth_flush_creds();
 
-		for (i = 0; i < IPHASHMAX; i++) {
+		for (i = 0; hashtable != NULL && i < (1U << hashbits); i++) {
 			for (hep = hashtable[i]; hep != NULL; hep = next) {
 				next = hep->next;
 				free (hep);
 			}
-			hashtable[i] = NULL;
-		}
-	} else {
-		for (i = 0; i < IPHASHMAX; i++) {
-			hashtable[i] = NULL;
 		}
+		if (hashtable != NULL)
+			free (hashtable);
 	}
+	hashtable = NULL;
+	hashbits = hashcount = 0;
+	auth_free_nmtree(netmask_tree);
+	netmask_tree = NULL;
+	netmask_odd = 0;
+	auth_free_mtree(export_tree);
+	export_tree = NULL;
+	lru_head = lru_tail = NULL;
+	lru_count = 0;
 
 	/* Get the default anon uid/gid */
 	if ((pw = getpwnam("nobody")) != NULL) {
@@ -1184,9 +1618,6 @@ auth_init_lists(void)
 	anonymous_options.nobody_uid = anon_uid;
 	anonymous_options.nobody_gid = anon_gid;
 
-	memset(cached_clients, 0, sizeof(cached_clients));
-	cached_next = 0;
-
 	initialized = 1;
 }
 
@@ -1211,6 +1642,7 @@ auth_free_list(nfs_client **cpp)
 				free(mp->o.clnt_nisdomain);
 			free (mp);
 		}
+		auth_free_mtree(cp->mtree);
 		if (cp->umap != NULL) {
 			ugid_free_map(cp->umap);
 		}
@@ -20,8 +20,12 @@ extern int			trace_spoof;
 extern struct exportnode	*export_list;
 extern uid_t			cred_uid, auth_uid;
 extern gid_t			cred_gid, auth_gid;
+extern GETGROUPS_T		auth_gids[];
+extern int			auth_gidlen;
 extern char *			public_root_path;
 extern struct nfs_fh		public_root;
+extern int			auth_dns_async;
+extern int			auth_clnt_pending;
 
 #if defined(linux) && defined(i386) && !defined(HAVE_SETFSUID)
 #   define MAYBE_HAVE_SETFSUID
@@ -59,6 +63,7 @@ typedef struct nfs_options {
 	int			link_relative;
 	int			noaccess;
 	int			cross_mounts;
+	int			async;
 	uid_t			nobody_uid;
 	gid_t			nobody_gid;
 	char *			clnt_nisdomain;
@@ -82,6 +87,7 @@ typedef struct nfs_client {
 	char *			clnt_name;
 	unsigned short		flags;
 	nfs_mount *		m;
+	struct nfs_mnode *	mtree;		/* m by path component */
 
 	/*
 	 * This is the uid/gid map.
@@ -113,9 +119,11 @@ extern void	  auth_free_lists(void);
 extern nfs_client *auth_clnt(struct svc_req *rqstp);
 extern nfs_mount  *auth_path(nfs_client *, struct svc_req *, char *);
 extern void       auth_user(nfs_mount *, struct svc_req *);
+extern void       auth_flush_creds(void);
 
 extern nfs_client *auth_get_client(char *);
 extern nfs_mount  *auth_match_mount(nfs_client *, char *);
+extern int	   auth_exported(const char *);
 extern nfs_client *auth_known_clientbyname(char *);
 extern nfs_client *auth_known_clientbyaddr(struct in_addr);
 extern nfs_client *auth_unknown_clientbyaddr(struct in_addr);
@@ -129,6 +137,18 @@ extern void       auth_check_all_netmasks(void);
 extern void	  auth_sort_all_mountlists(void);
 extern void	  auth_log_all(void);
 
+/* auth_dns.c */
+extern struct hostent *auth_dns_lookup(struct in_addr, int async,
+					int *pending);
+extern struct hostent *auth_dns_byname(const char *);
+extern void	  auth_dns_prefetch(char **names, int count);
+
+/* auth_netgr.c */
+extern void	  auth_netgroup_load(const char *);
+extern int	  auth_netgroup_refresh(void);
+extern int	  auth_netgroup_match(const char *, const char *);
+extern void	  auth_netgroup_clear(void);
+
 /* This function lets us set our euid/fsuid temporarily */
 extern void       auth_override_uid(uid_t);
 
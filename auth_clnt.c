@@ -21,6 +21,37 @@
 #endif
 
 
+/*
+ * auth_user remembers how the last few credentials it saw were mapped
+ * for a mount point, so that a client sending the same credential over
+ * and over doesn't go through luid/lgid for each of its groups on
+ * every request. The cache is cleared when the exports are reloaded.
+ * Mappings obtained from ugidd or NIS aren't kept here; ugid_map.c
+ * caches those itself, and lets them expire.
+ */
+#define CRED_CACHE_SIZE		16
+
+typedef struct authcred {
+	nfs_mount *		mount;		/* NULL: unused */
+	int			flavor;
+	uid_t			uid;		/* credential as sent */
+	gid_t			gid;
+	int			len;
+	gid_t			gids[NGRPS];
+	uid_t			cuid;		/* mapped */
+	gid_t			cgid;
+	int			clen;
+	GETGROUPS_T		cgids[NGRPS];
+} authcred;
+
+static authcred		cred_cache[CRED_CACHE_SIZE];
+static int		cred_last = 0;		/* most recent hit */
+static int		cred_next = 0;		/* next one to replace */
+
+/* The uid the kernel uses for file access right now. It differs from
+ * auth_uid while auth_override_uid is in effect. */
+static uid_t		auth_fsuid = ROOT_UID;
+
 #if defined(HAVE_SETFSUID) || defined(MAYBE_HAVE_SETFSUID)
 static void setfsids(uid_t, gid_t, gid_t *, int);
 #endif
@@ -59,7 +90,7 @@ auth_clnt(struct svc_req *rqstp)
 		return cp;
 
 	/* We don't know you */
-	if (trace_spoof) {
+	if (trace_spoof && !auth_clnt_pending) {
 		Dprintf(L_ERROR, "Unauthorized access by NFS client %s.\n",
 		    inet_ntoa(addr));
 	}
@@ -105,13 +136,69 @@ auth_path(nfs_client *cp, struct svc_req *rqstp, char *path)
 	return mp;
 }
 
+/*
+ * Find the mapping of the current credential in the cache.
+ */
+static authcred *
+auth_find_cred(nfs_mount *mp, int flavor)
+{
+	authcred	*cp;
+	int		i, n;
+
+	for (i = 0, n = cred_last; i < CRED_CACHE_SIZE; i++) {
+		cp = &cred_cache[n];
+		if (cp->mount == mp && cp->uid == cred_uid
+		 && cp->gid == cred_gid && cp->len == cred_len
+		 && cp->flavor == flavor
+		 && !memcmp(cp->gids, cred_gids, cred_len * sizeof(gid_t))) {
+			cred_last = n;
+			return cp;
+		}
+		n = (n + 1) % CRED_CACHE_SIZE;
+	}
+	return NULL;
+}
+
+/*
+ * Forget all mapped credentials. Called when the exports are reloaded,
+ * since the mount points are freed.
+ */
+void
+auth_flush_creds(void)
+{
+	memset(cred_cache, 0, sizeof(cred_cache));
+	cred_last = cred_next = 0;
+}
+
+/*
+ * Map the current credential, and remember what it was.
+ */
+static void
+auth_map_cred(authcred *cp, nfs_mount *mp, struct svc_req *rqstp)
+{
+	int	i;
+
+	cp->mount = mp;
+	cp->flavor = rqstp->rq_cred.oa_flavor;
+	cp->uid = cred_uid;
+	cp->gid = cred_gid;
+	cp->len = cred_len;
+	memcpy(cp->gids, cred_gids, cred_len * sizeof(gid_t));
+	cp->cuid = luid(cred_uid, mp, rqstp);
+	cp->cgid = lgid(cred_gid, mp, rqstp);
+	cp->clen = cred_len;
+	for (i = 0; i < cred_len; i++)
+		cp->cgids[i] = lgid(cred_gids[i], mp, rqstp);
+}
+
 void auth_user(nfs_mount *mp, struct svc_req *rqstp)
 {
 	uid_t		cuid;
 	gid_t		cgid;
-	GETGROUPS_T	cgids[NGRPS];
+	GETGROUPS_T	cgids[NGRPS], *gp;
+	authcred	*cp, dyncred;
 	int		squash = mp->o.all_squash;
-	int		cred_set, i, clen;
+	int		cred_set, clen;
 
 	cred_set = 0;
 	if (rqstp->rq_cred.oa_flavor == AUTH_UNIX) {
@@ -160,11 +247,20 @@ void auth_user(nfs_mount *mp, struct svc_req *rqstp)
 		else if (cred_len > NGRPS)
 			cred_len = NGRPS;
 
-		cuid = luid(cred_uid, mp, rqstp);
-		cgid = lgid(cred_gid, mp, rqstp);
-		clen = cred_len;
-		for (i = 0; i < cred_len; i++)
-			cgids[i] = lgid(cred_gids[i], mp, rqstp);
+		if (mp->o.uidmap == map_daemon || mp->o.uidmap == map_nis) {
+			cp = &dyncred;
+			auth_map_cred(cp, mp, rqstp);
+		} else if ((cp = auth_find_cred(mp,
+					rqstp->rq_cred.oa_flavor)) == NULL) {
+			cp = &cred_cache[cred_next];
+			cred_last = cred_next;
+			cred_next = (cred_next + 1) % CRED_CACHE_SIZE;
+			auth_map_cred(cp, mp, rqstp);
+		}
+		cuid = cp->cuid;
+		cgid = cp->cgid;
+		clen = cp->clen;
+		gp = cp->cgids;
 	} else {
 		/* On systems that have 32bit uid_t in user space but
 		 * 16bit in the kernel, we need to truncate the
@@ -180,6 +276,7 @@ void auth_user(nfs_mount *mp, struct svc_req *rqstp)
 		/* Construct a list of one gid. */
 		cgids[0] = cgid;
 		clen = 1;
+		gp = cgids;
 	}
 
 	/* This code is a little awkward because setfsuid has been present
@@ -193,14 +290,14 @@ void auth_user(nfs_mount *mp, struct svc_req *rqstp)
 	 * upper 16 bits set (including our default nobody uid -2).
 	 */
 #if defined(HAVE_SETFSUID)
-	setfsids(cuid, cgid, cgids, clen);
+	setfsids(cuid, cgid, gp, clen);
 #else
 #if defined(MAYBE_HAVE_SETFSUID)
 	if (have_setfsuid)
-		setfsids(cuid, cgid, cgids, clen);
+		setfsids(cuid, cgid, gp, clen);
 	else
 #endif
-		seteids(cuid, cgid, cgids, clen);
+		seteids(cuid, cgid, gp, clen);
 #endif
 }
 
@@ -210,12 +307,18 @@ void auth_user(nfs_mount *mp, struct svc_req *rqstp)
 void
 auth_override_uid(uid_t uid)
 {
-	/* extension hooks: */
-	efs_setfsuid(uid);
-
 #if defined(HAVE_BROKEN_SETFSUID)
 	uid = (unsigned short) uid;
 #endif
+	/* Every request starts with an override to root, and is then
+	 * switched to the user. Don't bother the kernel if nothing
+	 * changes. */
+	if (uid == auth_fsuid)
+		return;
+
+	/* extension hooks: */
+	efs_setfsuid(uid);
+
 #if defined(HAVE_SETFSUID)
 	setfsuid(uid);
 #else
@@ -226,27 +329,31 @@ auth_override_uid(uid_t uid)
 #endif
 		seteuid(uid);
 #endif
+	auth_fsuid = uid;
 }
 
 #if defined(HAVE_SETFSUID) || defined(MAYBE_HAVE_SETFSUID)
 static void
 setfsids(uid_t cred_uid, gid_t cred_gid, gid_t *cred_gids, int cred_len)
 {
-	/* extension hooks: */
-	efs_setfsuid(cred_uid);
-	efs_setfsgid(cred_gid);
-
 	/* First, set the user ID. */
-	if (auth_uid != cred_uid) {
+	auth_uid = cred_uid;
+	if (auth_fsuid != cred_uid) {
+		/* extension hooks: */
+		efs_setfsuid(cred_uid);
+
 		if (setfsuid(cred_uid) < 0)
 			Dprintf(L_ERROR, "Unable to setfsuid %d: %s\n",
 			    cred_uid, strerror(errno));
 		else
-			auth_uid = cred_uid;
+			auth_fsuid = cred_uid;
 	}
 
 	/* Next, the group ID. */
 	if (auth_gid != cred_gid) {
+		/* extension hooks: */
+		efs_setfsgid(cred_gid);
+
 		if (setfsgid(cred_gid) < 0)
 			Dprintf(L_ERROR, "Unable to setfsgid %d: %s\n",
 			    cred_gid, strerror(errno));
@@ -277,20 +384,19 @@ setfsids(uid_t cred_uid, gid_t cred_gid, gid_t *cred_gids, int cred_len)
 static void
 seteids(uid_t cred_uid, gid_t cred_gid, gid_t *cred_gids, int cred_len)
 {
-	/* extension hooks: */
-	efs_setfsuid(cred_uid);
-	efs_setfsgid(cred_gid);
-
 	/* To set any IDs we first need to be root. What a pain. */
 
 	/* First set the group ID. */
 	if (auth_gid != cred_gid) {
-		if (auth_uid != ROOT_UID) {
+		/* extension hooks: */
+		efs_setfsgid(cred_gid);
+
+		if (auth_fsuid != ROOT_UID) {
 			if (seteuid(ROOT_UID) < 0)
 				Dprintf(L_ERROR, "Unable to seteuid(%d): %s\n",
 				    ROOT_UID, strerror(errno));
 			else
-				auth_uid = ROOT_UID;
+				auth_fsuid = ROOT_UID;
 		}
 		if (setegid(cred_gid) < 0)
 			Dprintf(L_ERROR, "Unable to setegid(%d): %s\n",
@@ -305,12 +411,12 @@ seteids(uid_t cred_uid, gid_t cred_gid, gid_t *cred_gids, int cred_len)
 		Dprintf(L_ERROR, "Negative or huge cred_len: %d\n", cred_len);
 	else if (cred_len != auth_gidlen
 	    || memcmp(cred_gids, auth_gids, auth_gidlen*sizeof(gid_t))) {
-		if (auth_uid != ROOT_UID) {
+		if (auth_fsuid != ROOT_UID) {
 			if (seteuid(ROOT_UID) < 0)
 				Dprintf(L_ERROR, "Unable to seteuid(%d): %s\n",
 				    ROOT_UID, strerror(errno));
 			else
-				auth_uid = ROOT_UID;
+				auth_fsuid = ROOT_UID;
 		}
 		if (setgroups(cred_len, cred_gids) < 0)
 			Dprintf(L_ERROR, "Unable to setgroups: %s\n",
@@ -323,15 +429,19 @@ seteids(uid_t cred_uid, gid_t cred_gid, gid_t *cred_gids, int cred_len)
 #endif /* HAVE_SETGROUPS */
 
 	/* Finally, set the user ID. */
-	if (auth_uid != cred_uid) {
-		if (auth_uid != ROOT_UID && seteuid(ROOT_UID) < 0)
+	auth_uid = cred_uid;
+	if (auth_fsuid != cred_uid) {
+		/* extension hooks: */
+		efs_setfsuid(cred_uid);
+
+		if (auth_fsuid != ROOT_UID && seteuid(ROOT_UID) < 0)
 			Dprintf(L_ERROR, "Unable to seteuid(%d): %s\n", 
 				ROOT_UID, strerror(errno));
 		if (seteuid(cred_uid) < 0)
 			Dprintf(L_ERROR, "Unable to seteuid(%d): %s\n",
 			    cred_uid, strerror(errno));
 		else
-			auth_uid = cred_uid;
+			auth_fsuid = cred_uid;
 	}
 }
 #endif
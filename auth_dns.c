@@ -0,0 +1,636 @@
+/*
+ * auth_dns.c	Cache of client host name lookups.
+ *
+ *		The first request from an address we know nothing about
+ *		requires a reverse lookup, and a forward lookup to verify
+ *		it. Results, including failures, are cached for a while,
+ *		so that clients that come back, and reloads of the exports
+ *		file, don't go to the name server again. The same goes for
+ *		the forward lookups of host names in the exports file.
+ *
+ *		When auth_dns_async is set (nfsd does this for requests
+ *		that came in over UDP), a lookup that isn't in the cache
+ *		is done by a child process, and the caller is told to try
+ *		again later. The request is then dropped or answered with
+ *		JUKEBOX, and the client's retransmission finds the result
+ *		in the cache. A slow name server thus no longer holds up
+ *		all other clients. Otherwise, we wait for the answer.
+ *
+ *		Before the exports file is parsed, auth_dns_prefetch looks
+ *		up all host names in it in parallel. Names that aren't
+ *		resolved within DNS_LOAD_TIMEOUT are treated like names
+ *		that don't resolve: the client is matched by name when it
+ *		first shows up. Their lookups go on in the background.
+ *
+ *		The resolver library doesn't tell us the TTL of the
+ *		records, so we use fixed times instead.
+ */
+
+#include "nfsd.h"
+#include <sys/wait.h>
+#include <sys/poll.h>
+
+#define DNS_HASH_SIZE	256
+#define DNS_CACHE_MAX	4096
+#define DNS_POS_TTL	(30*60)		/* 30 minutes			*/
+#define DNS_NEG_TTL	60		/* 1 minute			*/
+#define DNS_TIMEOUT	30		/* give up on a lookup		*/
+#define DNS_LOAD_TIMEOUT 5		/* wait for exports lookups	*/
+#define DNS_MAX_PENDING	16		/* lookups at the same time	*/
+#define DNS_MAX_ADDRS	8
+#define DNS_LINE_MAX	512		/* less than PIPE_BUF		*/
+#define DNS_QUEUED	((pid_t) -1)
+
+typedef struct dns_ent {
+	struct dns_ent *	hash_next;
+	struct dns_ent *	older;		/* in order of creation */
+	struct dns_ent *	newer;
+	char *			query;		/* NULL: reverse lookup */
+	struct in_addr		addr;
+	char *			name;		/* NULL: lookup failed */
+	int			naddrs;
+	struct in_addr *	addrs;
+	time_t			expires;
+	pid_t			pid;		/* lookup in progress,
+						 * DNS_QUEUED: not started */
+	int			fd;
+} dns_ent;
+
+int			auth_dns_async = 0;
+
+static dns_ent *	dns_hash[DNS_HASH_SIZE];
+static dns_ent *	dns_oldest = NULL;
+static dns_ent *	dns_newest = NULL;
+static int		dns_count = 0;
+static dns_ent *	dns_pending[DNS_MAX_PENDING];
+static int		dns_npending = 0;
+static int		dns_nqueued = 0;
+
+/* What we return to callers. Like that of gethostbyaddr, it is
+ * overwritten by the next call. */
+static struct hostent	dns_hostent;
+static char *		dns_aliases[1];
+static char *		dns_addr_list[DNS_MAX_ADDRS + 1];
+
+/*
+ * Perform a reverse lookup on a client IP, and make sure the name
+ * maps back to the address.
+ */
+static struct hostent *
+dns_reverse(struct in_addr addr)
+{
+	struct hostent	*hp;
+	char		nambuf[256];
+	char		**ap;
+
+	hp = gethostbyaddr((char *) &addr, sizeof(addr), AF_INET);
+
+	Dprintf(D_AUTH, "auth_reverse_lookup(%s) %s\n",
+		inet_ntoa(addr), hp? hp->h_name : "[FAIL]");
+
+	if (hp != NULL) {
+		const char	*n = hp->h_name;
+		int		i;
+
+		/* Keep temp copy of hostname. We must take care
+		 * of trailing white space because some NIS servers
+		 * put it into their maps, and libc doesn't remove it.
+		 */
+		for (i = 0; *n && i < sizeof(nambuf)-1; i++, n++) {
+			if (*n == ' ' || *n == '\t')
+				break;
+			nambuf[i] = *n;
+		}
+		nambuf[i] = '\0';
+
+		/*
+		 * Do a forward lookup
+		 * (FIXME: resolver lib may already have done this).
+		 */
+		hp = gethostbyname(nambuf);
+		if (hp == NULL) {
+			Dprintf(L_ERROR,
+				"couldn't verify address of host %s\n",
+				inet_ntoa(addr));
+			return NULL;
+		}
+		if (hp->h_addrtype != AF_INET) {
+			Dprintf(L_WARNING,
+				"%s has address type %d != AF_INET.\n",
+				inet_ntoa(addr), hp->h_addrtype);
+			return NULL;
+		}
+		if (hp->h_length != 4) {
+			Dprintf(L_WARNING,
+				"%s has address length %d != 4.\n",
+				inet_ntoa(addr), hp->h_length);
+			return NULL;
+		}
+
+		/*
+		 * Make sure this isn't a spoof attempt.
+		 */
+		for (ap = hp->h_addr_list; *ap != NULL; ap++) {
+			if (!memcmp(*ap, &addr, hp->h_length))
+				break;
+		}
+
+		if (*ap == NULL) {
+			Dprintf(L_ERROR,
+				"spoof attempt by %s: pretends to be %s!\n",
+				inet_ntoa(addr), hp->h_name);
+			return NULL;
+		}
+	}
+
+	return hp;
+}
+
+/*
+ * Perform a forward lookup on a hostname, with checks
+ */
+static struct hostent *
+dns_forward(const char *hname)
+{
+	struct hostent	*hp;
+
+	hp = gethostbyname(hname);
+
+	Dprintf(D_AUTH, "auth_forward_lookup(%s) %s\n",
+		hname, hp? hp->h_name : "[FAIL]");
+
+	if (hp != NULL) {
+		if (hp->h_addrtype != AF_INET) {
+			Dprintf(L_WARNING,
+				"%s has address type %d != AF_INET.\n",
+				hname, hp->h_addrtype);
+			return NULL;
+		}
+		if (hp->h_length != 4) {
+			Dprintf(L_WARNING,
+				"%s has address length %d != 4.\n",
+				hname, hp->h_length);
+			return NULL;
+		}
+	}
+	return hp;
+}
+
+static struct hostent *
+dns_resolve(dns_ent *ep)
+{
+	return ep->query? dns_forward(ep->query) : dns_reverse(ep->addr);
+}
+
+static const char *
+dns_what(dns_ent *ep)
+{
+	return ep->query? ep->query : inet_ntoa(ep->addr);
+}
+
+/*
+ * Reverse lookups are keyed by address, forward lookups by name.
+ */
+static unsigned int
+dns_hashval(struct in_addr addr, const char *query)
+{
+	unsigned int	h = 0;
+
+	if (query == NULL)
+		return (ntohl(addr.s_addr) * 2654435761U) >> 24;
+	while (*query)
+		h = h * 31 + tolower((unsigned char) *query++);
+	return h & (DNS_HASH_SIZE - 1);
+}
+
+static dns_ent **
+dns_lookup(struct in_addr addr, const char *query)
+{
+	dns_ent	**epp, *ep;
+
+	epp = &dns_hash[dns_hashval(addr, query)];
+	while ((ep = *epp) != NULL) {
+		if (query == NULL) {
+			if (ep->query == NULL && ep->addr.s_addr == addr.s_addr)
+				break;
+		} else if (ep->query != NULL && !strcasecmp(ep->query, query))
+			break;
+		epp = &ep->hash_next;
+	}
+	return epp;
+}
+
+static void
+dns_clear(dns_ent *ep)
+{
+	if (ep->name != NULL)
+		free(ep->name);
+	if (ep->addrs != NULL)
+		free(ep->addrs);
+	ep->name = NULL;
+	ep->addrs = NULL;
+	ep->naddrs = 0;
+}
+
+static void
+dns_delete(dns_ent *ep)
+{
+	dns_ent	**epp = dns_lookup(ep->addr, ep->query);
+
+	*epp = ep->hash_next;
+	if (ep->older != NULL)
+		ep->older->newer = ep->newer;
+	else
+		dns_oldest = ep->newer;
+	if (ep->newer != NULL)
+		ep->newer->older = ep->older;
+	else
+		dns_newest = ep->older;
+	dns_clear(ep);
+	if (ep->query != NULL)
+		free(ep->query);
+	free(ep);
+	dns_count--;
+}
+
+/*
+ * Make a new entry, making room for it if the cache is full. Entries
+ * whose lookup is still in progress are left alone.
+ */
+static dns_ent *
+dns_create(struct in_addr addr, const char *query)
+{
+	dns_ent	*ep, **epp;
+
+	for (ep = dns_oldest; dns_count >= DNS_CACHE_MAX && ep != NULL; ) {
+		dns_ent	*next = ep->newer;
+
+		if (ep->pid == 0)
+			dns_delete(ep);
+		ep = next;
+	}
+
+	ep = (dns_ent *) xmalloc(sizeof(*ep));
+	memset(ep, 0, sizeof(*ep));
+	ep->addr = addr;
+	ep->query = query? xstrdup(query) : NULL;
+	ep->fd = -1;
+	epp = dns_lookup(addr, query);
+	ep->hash_next = *epp;
+	*epp = ep;
+	ep->older = dns_newest;
+	if (dns_newest != NULL)
+		dns_newest->newer = ep;
+	else
+		dns_oldest = ep;
+	dns_newest = ep;
+	dns_count++;
+	return ep;
+}
+
+/*
+ * Remember the result of a lookup.
+ */
+static void
+dns_store(dns_ent *ep, const char *name, struct in_addr *addrs, int naddrs)
+{
+	dns_clear(ep);
+	if (name != NULL) {
+		ep->name = xstrdup(name);
+		ep->addrs = (struct in_addr *)
+				xmalloc(naddrs * sizeof(struct in_addr));
+		memcpy(ep->addrs, addrs, naddrs * sizeof(struct in_addr));
+		ep->naddrs = naddrs;
+		ep->expires = time(NULL) + DNS_POS_TTL;
+	} else {
+		ep->expires = time(NULL) + DNS_NEG_TTL;
+	}
+}
+
+static void
+dns_store_hostent(dns_ent *ep, struct hostent *hp)
+{
+	struct in_addr	addrs[DNS_MAX_ADDRS];
+	int		n;
+
+	if (hp == NULL) {
+		dns_store(ep, NULL, NULL, 0);
+		return;
+	}
+	for (n = 0; n < DNS_MAX_ADDRS && hp->h_addr_list[n] != NULL; n++)
+		addrs[n] = *(struct in_addr *) hp->h_addr_list[n];
+	dns_store(ep, hp->h_name, addrs, n);
+}
+
+/*
+ * Start a lookup in a child process, which writes the name and the
+ * addresses of the host to a pipe, or nothing if the lookup fails.
+ * Returns 0 if that isn't possible.
+ */
+static int
+dns_start(dns_ent *ep)
+{
+	struct hostent	*hp;
+	char		line[DNS_LINE_MAX];
+	int		fds[2], len, n;
+	pid_t		pid;
+
+	if (pipe(fds) < 0)
+		return 0;
+	if ((pid = fork()) < 0) {
+		Dprintf(L_ERROR, "unable to fork for DNS lookup: %s\n",
+			strerror(errno));
+		close(fds[0]);
+		close(fds[1]);
+		return 0;
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		len = 0;
+		if ((hp = dns_resolve(ep)) != NULL) {
+			len = sprintf(line, "%.255s", hp->h_name);
+			for (n = 0; n < DNS_MAX_ADDRS && hp->h_addr_list[n]; n++)
+				len += sprintf(line + len, " %s",
+				   inet_ntoa(*(struct in_addr *) hp->h_addr_list[n]));
+			line[len++] = '\n';
+		}
+		if (len)
+			write(fds[1], line, len);
+		_exit(0);
+	}
+
+	close(fds[1]);
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	ep->pid = pid;
+	ep->fd = fds[0];
+	ep->expires = time(NULL) + DNS_TIMEOUT;
+	dns_pending[dns_npending++] = ep;
+	Dprintf(D_AUTH, "started lookup of %s (pid %d)\n", dns_what(ep), pid);
+	return 1;
+}
+
+/*
+ * See whether a lookup has finished. Returns 0 if it is still going.
+ */
+static int
+dns_collect(dns_ent *ep)
+{
+	struct in_addr	addrs[DNS_MAX_ADDRS];
+	char		line[DNS_LINE_MAX], *sp, *name;
+	int		n, naddrs = 0;
+
+	n = read(ep->fd, line, sizeof(line) - 1);
+	if (n < 0 && errno == EAGAIN) {
+		if (time(NULL) < ep->expires)
+			return 0;
+		Dprintf(L_WARNING, "lookup of %s timed out\n", dns_what(ep));
+		kill(ep->pid, SIGKILL);
+		n = 0;
+	}
+	close(ep->fd);
+	waitpid(ep->pid, NULL, 0);
+	ep->fd = -1;
+	ep->pid = 0;
+
+	if (n <= 0 || line[n-1] != '\n') {
+		dns_store(ep, NULL, NULL, 0);
+		return 1;
+	}
+	line[n-1] = '\0';
+	name = strtok(line, " ");
+	while ((sp = strtok(NULL, " ")) != NULL && naddrs < DNS_MAX_ADDRS) {
+		if (inet_aton(sp, &addrs[naddrs]))
+			naddrs++;
+	}
+	dns_store(ep, name, addrs, naddrs);
+	return 1;
+}
+
+/*
+ * Pick up the results of all lookups that have finished.
+ */
+static void
+dns_collect_all(void)
+{
+	dns_ent	*ep;
+	int	i;
+
+	for (i = 0; i < dns_npending; ) {
+		if (dns_collect(dns_pending[i]))
+			dns_pending[i] = dns_pending[--dns_npending];
+		else
+			i++;
+	}
+
+	/* Start queued lookups as others finish */
+	for (ep = dns_oldest; dns_nqueued && ep != NULL; ep = ep->newer) {
+		if (ep->pid != DNS_QUEUED)
+			continue;
+		if (dns_npending >= DNS_MAX_PENDING)
+			break;
+		dns_nqueued--;
+		ep->pid = 0;
+		if (!dns_start(ep))
+			dns_store(ep, NULL, NULL, 0);
+	}
+}
+
+/*
+ * Find the cache entry for a lookup, throwing it away if it has expired.
+ */
+static dns_ent *
+dns_find(struct in_addr addr, const char *query)
+{
+	dns_ent	*ep;
+
+	if (dns_npending)
+		dns_collect_all();
+	if ((ep = *dns_lookup(addr, query)) != NULL
+	 && ep->pid == 0 && ep->expires <= time(NULL)) {
+		dns_delete(ep);
+		ep = NULL;
+	}
+	return ep;
+}
+
+/*
+ * Wait for a lookup started earlier, or do it now if it is still queued.
+ */
+static void
+dns_wait(dns_ent *ep)
+{
+	struct pollfd	pfd;
+	int		i;
+
+	if (ep->pid == DNS_QUEUED) {
+		dns_nqueued--;
+		ep->pid = 0;
+		dns_store_hostent(ep, dns_resolve(ep));
+		return;
+	}
+
+	Dprintf(D_AUTH, "waiting for lookup of %s\n", dns_what(ep));
+	pfd.fd = ep->fd;
+	pfd.events = POLLIN;
+	do {
+		poll(&pfd, 1, 1000);
+	} while (!dns_collect(ep));
+	for (i = 0; i < dns_npending; i++) {
+		if (dns_pending[i] == ep) {
+			dns_pending[i] = dns_pending[--dns_npending];
+			break;
+		}
+	}
+}
+
+/*
+ * Look up an address (query == NULL) or a host name. If async is set
+ * and the answer isn't known yet, *pending is set and NULL returned.
+ * Otherwise, we wait for a lookup of the same thing that is still
+ * going on.
+ */
+static struct hostent *
+dns_get(struct in_addr addr, const char *query, int async, int *pending)
+{
+	dns_ent	*ep;
+	int	n;
+
+	*pending = 0;
+	if ((ep = dns_find(addr, query)) == NULL) {
+		/* If there are too many lookups going on, the client
+		 * will have to come back later. */
+		if (async && dns_npending >= DNS_MAX_PENDING) {
+			*pending = 1;
+			return NULL;
+		}
+		ep = dns_create(addr, query);
+		if (!async || !dns_start(ep))
+			dns_store_hostent(ep, dns_resolve(ep));
+	}
+	if (ep->pid != 0) {
+		if (async) {
+			*pending = 1;
+			return NULL;
+		}
+		dns_wait(ep);
+	}
+	if (ep->name == NULL)
+		return NULL;
+
+	Dprintf(D_AUTH, "auth_dns_lookup(%s) %s\n", dns_what(ep), ep->name);
+	for (n = 0; n < ep->naddrs; n++)
+		dns_addr_list[n] = (char *) &ep->addrs[n];
+	dns_addr_list[n] = NULL;
+	dns_aliases[0] = NULL;
+	dns_hostent.h_name = ep->name;
+	dns_hostent.h_aliases = dns_aliases;
+	dns_hostent.h_addrtype = AF_INET;
+	dns_hostent.h_length = sizeof(struct in_addr);
+	dns_hostent.h_addr_list = dns_addr_list;
+	return &dns_hostent;
+}
+
+/*
+ * Look up the host name of a client address. Returns NULL if the
+ * address has no (verifiable) name. If async is set and the answer
+ * isn't known yet, *pending is set and NULL returned.
+ */
+struct hostent *
+auth_dns_lookup(struct in_addr addr, int async, int *pending)
+{
+	return dns_get(addr, NULL, async, pending);
+}
+
+/*
+ * Look up the addresses of a host name.
+ */
+struct hostent *
+auth_dns_byname(const char *hname)
+{
+	struct in_addr	any;
+	int		pending;
+
+	any.s_addr = INADDR_ANY;
+	return dns_get(any, hname, 0, &pending);
+}
+
+/*
+ * Look up a list of host names in parallel, for the exports parser.
+ * Dotted quads get a reverse lookup instead. Returns when all lookups
+ * are done, or after DNS_LOAD_TIMEOUT seconds.
+ */
+void
+auth_dns_prefetch(char **names, int count)
+{
+	struct pollfd	pfd[DNS_MAX_PENDING];
+	struct in_addr	addr;
+	const char	*query;
+	time_t		start = time(NULL), last = start;
+	int		next = 0, ok = 0, failed = 0, i;
+	dns_ent		*ep;
+
+	while (next < count || dns_npending) {
+		while (next < count && dns_npending < DNS_MAX_PENDING) {
+			query = names[next++];
+			addr.s_addr = INADDR_ANY;
+			if (inet_aton(query, &addr))
+				query = NULL;
+			if (dns_find(addr, query) != NULL)
+				continue;
+			/* If we can't fork, the parser will have to do
+			 * the remaining lookups itself. */
+			ep = dns_create(addr, query);
+			if (!dns_start(ep)) {
+				dns_delete(ep);
+				next = count;
+			}
+		}
+		if (dns_npending == 0)
+			break;
+		if (time(NULL) >= start + DNS_LOAD_TIMEOUT) {
+			/* Look up the rest in the background */
+			while (next < count) {
+				query = names[next++];
+				addr.s_addr = INADDR_ANY;
+				if (inet_aton(query, &addr))
+					query = NULL;
+				if (dns_find(addr, query) == NULL) {
+					dns_create(addr, query)->pid = DNS_QUEUED;
+					dns_nqueued++;
+				}
+			}
+			break;
+		}
+
+		for (i = 0; i < dns_npending; i++) {
+			pfd[i].fd = dns_pending[i]->fd;
+			pfd[i].events = POLLIN;
+		}
+		poll(pfd, dns_npending, 1000);
+		dns_collect_all();
+
+		if (time(NULL) != last) {
+			last = time(NULL);
+			Dprintf(D_AUTH, "looked up %d of %d host names\n",
+				next - dns_npending, count);
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		query = names[i];
+		addr.s_addr = INADDR_ANY;
+		if (inet_aton(query, &addr))
+			query = NULL;
+		if ((ep = *dns_lookup(addr, query)) == NULL || ep->pid != 0)
+			continue;
+		if (ep->name != NULL)
+			ok++;
+		else
+			failed++;
+	}
+	if (count)
+		Dprintf(L_NOTICE, "resolved %d of %d host names in %ld seconds "
+			"(%d failed, %d not done yet)\n",
+			ok, count, (long) (time(NULL) - start),
+			failed, count - ok - failed);
+}
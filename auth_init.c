@@ -50,6 +50,7 @@ static char *	parse_opts(char *, char, nfs_mount *, char *);
 static void	parse_squash(nfs_mount *mp, int uidflag, char **cpp);
 static int	parse_num(char **cpp);
 static void	free_exports(void);
+static void	prefetch_hosts(FILE *);
 
 static int
 filt_getc(FILE *f)
@@ -312,9 +313,9 @@ parse_opts(char *cp, char terminator, nfs_mount *mp, char *client_name)
 		else if (strncmp(kwd, "anongid=", 8) == 0)
 			mp->o.nobody_gid = parse_num(&cp);
 		else if (strncmp(kwd, "async", 5) == 0)
-			/* knfsd compatibility, ignore */;
+			mp->o.async = 1;
 		else if (strncmp(kwd, "sync", 4) == 0)
-			/* knfsd compatibility, ignore */;
+			mp->o.async = 0;
 		else {
 			Dprintf(L_ERROR,
 				"Unknown keyword \"%.*s\" in export file\n",
@@ -359,6 +360,62 @@ parse_opts(char *cp, char terminator, nfs_mount *mp, char *client_name)
 	return (cp);
 }
 
+/*
+ * Look up all host names in the exports file in parallel before
+ * parsing it, so that get_client finds them in the DNS cache. Hosts
+ * that take too long are left for later; see auth_dns.c.
+ */
+static void
+prefetch_hosts(FILE *ef)
+{
+	char	**names = NULL, *lbuf, *cp, *hname, cc;
+	int	count = 0, size = 0;
+
+	while (export_getline(&lbuf, ef)) {
+		/* Skip the file system name */
+		for (cp = lbuf; isspace(*cp); cp++)
+			;
+		while (*cp != '\0' && !isspace(*cp))
+			cp++;
+
+		while (*cp != '\0') {
+			while (isspace(*cp))
+				cp++;
+			if (*cp == '(') {
+				while (*cp != '\0' && *cp != ')')
+					cp++;
+				if (*cp != '\0')
+					cp++;
+				continue;
+			}
+			hname = cp;
+			while (*cp != '\0' && !isspace(*cp) && *cp != '(')
+				cp++;
+			cc = *cp; *cp = '\0';
+
+			/* Netgroups, wildcards and netmasks aren't looked up */
+			if (*hname != '\0' && *hname != '@' && *hname != '='
+			 && strpbrk(hname, "*?/") == NULL) {
+				if (count == size) {
+					size = size? 2 * size : 64;
+					names = (char **) xrealloc(names,
+							size * sizeof(char *));
+				}
+				names[count++] = xstrdup(hname);
+			}
+			*cp = cc;
+		}
+		free(lbuf);
+	}
+	rewind(ef);
+
+	auth_dns_prefetch(names, count);
+	while (count)
+		free(names[--count]);
+	if (names != NULL)
+		free(names);
+}
+
 static nfs_client *
 get_client(char *hname)
 {
@@ -385,13 +442,8 @@ auth_init(char *fname)
 	char		path[PATH_MAX];
 	char		resolved_path[PATH_MAX];
 
-	if (auth_initialized) {
-		free_exports();
+	if (auth_initialized)
 		fname = auth_file;
-	}
-
-	auth_init_lists();
-
 	if (fname == NULL)
 		fname = EXPORTSFILE;
 	auth_file = fname;	/* Save for re-initialization */
@@ -417,8 +469,18 @@ auth_init(char *fname)
 	if ((ef = fopen(fname, "r")) == NULL) {
 		Dprintf(L_ERROR, "Could not open exports file %s: %s\n",
 			fname, strerror(errno));
+		if (auth_initialized) {
+			Dprintf(L_ERROR, "keeping the old exports\n");
+			return;
+		}
 		exit(1);
 	}
+	prefetch_hosts(ef);
+
+	/* Only now that we have the new exports do we drop the old */
+	if (auth_initialized)
+		free_exports();
+	auth_init_lists();
 	while (export_getline(&cp, ef)) {
 		char		*saved_line = cp;
 		char		*mount_point, *host_name, cc;
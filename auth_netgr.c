@@ -0,0 +1,403 @@
+/*
+ * auth_netgr.c	Netgroup membership sets.
+ *
+ *		Asking innetgr whether a host is in a netgroup can mean a
+ *		round trip to the NIS or LDAP server, and every new client
+ *		is checked against every netgroup in the exports file.
+ *		Instead, each netgroup is expanded once when the exports
+ *		are loaded, and its hosts go into a hash table.
+ *
+ *		Every NG_REFRESH seconds, a child process expands the
+ *		netgroup again and sends its members back through a pipe,
+ *		so that requests never wait for the name service. When a
+ *		new member list has come in, auth.c forgets which hosts it
+ *		has turned away.
+ *
+ *		A netgroup that can't be enumerated is left to innetgr.
+ */
+
+#include "nfsd.h"
+#include <sys/wait.h>
+
+#ifdef HAVE_INNETGR
+
+#define NG_HASH_MIN	64
+#define NG_REFRESH	(15*60)		/* 15 minutes			*/
+#define NG_TIMEOUT	60		/* give up on a refresh		*/
+#define NG_LINE_MAX	1024
+
+/*
+ * It appears to be an old and long-standing tradition on Unices not
+ * to declare the netgroup functions in any header file.
+ * Glibc departs from that tradition, but I'm too lazy to devise an
+ * autoconf test for that...
+ */
+#if !defined(__GLIBC__)
+extern int  innetgr(const char *netgroup, const char *host,
+		    const char *user, const char *domain);
+extern int  setnetgrent(const char *netgroup);
+extern int  getnetgrent(char **host, char **user, char **domain);
+extern void endnetgrent(void);
+#endif
+
+typedef struct ng_member {
+	struct ng_member *	next;
+	char *			domain;		/* NULL: any domain */
+	char			host[1];
+} ng_member;
+
+typedef struct ng_set {
+	struct ng_set *		next;
+	char *			name;
+	int			compiled;	/* 0: ask innetgr */
+	int			any_host;	/* member with empty host */
+	ng_member **		hash;
+	unsigned int		hashsize;
+	unsigned int		count;
+	time_t			expires;
+	time_t			since;		/* refresh started */
+	pid_t			pid;		/* refresh in progress */
+	int			fd;
+	char *			buf;		/* what the child sent */
+	size_t			buflen;
+	size_t			bufsize;
+} ng_set;
+
+static ng_set *		ng_sets = NULL;
+
+static unsigned int
+ng_hashval(const char *name, unsigned int size)
+{
+	unsigned int	h = 0;
+
+	while (*name)
+		h = h * 31 + tolower((unsigned char) *name++);
+	return h & (size - 1);
+}
+
+static void
+ng_clear(ng_set *sp)
+{
+	ng_member	*mp, *next;
+	unsigned int	i;
+
+	for (i = 0; i < sp->hashsize; i++) {
+		for (mp = sp->hash[i]; mp != NULL; mp = next) {
+			next = mp->next;
+			if (mp->domain != NULL)
+				free(mp->domain);
+			free(mp);
+		}
+	}
+	if (sp->hash != NULL)
+		free(sp->hash);
+	sp->hash = NULL;
+	sp->hashsize = sp->count = 0;
+	sp->any_host = 0;
+}
+
+static void
+ng_grow(ng_set *sp)
+{
+	ng_member	**old = sp->hash, *mp, *next;
+	unsigned int	i, oldsize = sp->hashsize, h;
+
+	sp->hashsize = oldsize? 2 * oldsize : NG_HASH_MIN;
+	sp->hash = (ng_member **) xmalloc(sp->hashsize * sizeof(ng_member *));
+	memset(sp->hash, 0, sp->hashsize * sizeof(ng_member *));
+	for (i = 0; i < oldsize; i++) {
+		for (mp = old[i]; mp != NULL; mp = next) {
+			next = mp->next;
+			h = ng_hashval(mp->host, sp->hashsize);
+			mp->next = sp->hash[h];
+			sp->hash[h] = mp;
+		}
+	}
+	if (old != NULL)
+		free(old);
+}
+
+/*
+ * Add a (host, domain) pair. As with innetgr, an empty host matches
+ * every host, and an empty domain every domain.
+ */
+static void
+ng_add(ng_set *sp, const char *host, const char *domain)
+{
+	ng_member	*mp;
+	unsigned int	h;
+
+	if (host == NULL || *host == '\0') {
+		sp->any_host = 1;
+		return;
+	}
+	if (!strcmp(host, "-"))
+		return;
+	if (sp->count >= sp->hashsize)
+		ng_grow(sp);
+
+	mp = (ng_member *) xmalloc(sizeof(*mp) + strlen(host));
+	strcpy(mp->host, host);
+	mp->domain = (domain && *domain)? xstrdup(domain) : NULL;
+	h = ng_hashval(host, sp->hashsize);
+	mp->next = sp->hash[h];
+	sp->hash[h] = mp;
+	sp->count++;
+}
+
+/*
+ * Is there a member with this host name, in this domain (NULL: any)?
+ */
+static int
+ng_lookup(ng_set *sp, const char *host, const char *domain)
+{
+	ng_member	*mp;
+
+	if (sp->hashsize == 0)
+		return 0;
+	for (mp = sp->hash[ng_hashval(host, sp->hashsize)]; mp; mp = mp->next) {
+		if (strcasecmp(mp->host, host))
+			continue;
+		if (domain == NULL || mp->domain == NULL
+		 || !strcasecmp(mp->domain, domain))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Expand a netgroup into the set. Returns 0 if it can't be enumerated.
+ */
+static int
+ng_expand(ng_set *sp)
+{
+	char	*host, *user, *domain;
+
+	if (!setnetgrent(sp->name)) {
+		endnetgrent();
+		return 0;
+	}
+	while (getnetgrent(&host, &user, &domain))
+		ng_add(sp, host, domain);
+	endnetgrent();
+	return 1;
+}
+
+/*
+ * Expand the netgroup again in a child process, which writes one line
+ * "host domain" per member, with "*" for empty fields.
+ */
+static void
+ng_start(ng_set *sp)
+{
+	char	*host, *user, *domain;
+	int	fds[2];
+	FILE	*fp;
+	pid_t	pid;
+
+	sp->since = time(NULL);
+	sp->expires = sp->since + NG_REFRESH;
+	if (pipe(fds) < 0)
+		return;
+	if ((pid = fork()) < 0) {
+		Dprintf(L_ERROR, "unable to fork for netgroup refresh: %s\n",
+			strerror(errno));
+		close(fds[0]);
+		close(fds[1]);
+		return;
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		if (!setnetgrent(sp->name) || (fp = fdopen(fds[1], "w")) == NULL)
+			_exit(1);
+		while (getnetgrent(&host, &user, &domain)) {
+			fprintf(fp, "%.255s %.255s\n",
+				(host && *host)? host : "*",
+				(domain && *domain)? domain : "*");
+		}
+		endnetgrent();
+		_exit(fclose(fp) != 0);
+	}
+
+	close(fds[1]);
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	sp->pid = pid;
+	sp->fd = fds[0];
+	sp->buflen = 0;
+	Dprintf(D_AUTH, "refreshing netgroup %s (pid %d)\n", sp->name, pid);
+}
+
+/*
+ * Read what the child has sent so far. Returns 1 if the new member
+ * list has replaced the old one.
+ */
+static int
+ng_collect(ng_set *sp)
+{
+	char	*line, *end, *domain;
+	int	n, status;
+
+	for (;;) {
+		if (sp->bufsize - sp->buflen < NG_LINE_MAX) {
+			sp->bufsize = sp->bufsize? 2 * sp->bufsize : 4096;
+			sp->buf = (char *) xrealloc(sp->buf, sp->bufsize);
+		}
+		n = read(sp->fd, sp->buf + sp->buflen,
+				sp->bufsize - sp->buflen - 1);
+		if (n <= 0)
+			break;
+		sp->buflen += n;
+	}
+	if (n < 0 && errno == EAGAIN) {
+		if (time(NULL) < sp->since + NG_TIMEOUT)
+			return 0;
+		Dprintf(L_WARNING, "refresh of netgroup %s timed out\n",
+			sp->name);
+		kill(sp->pid, SIGKILL);
+	}
+	close(sp->fd);
+	waitpid(sp->pid, &status, 0);
+	sp->fd = -1;
+	sp->pid = 0;
+
+	if (n != 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		Dprintf(L_WARNING, "couldn't refresh netgroup %s, "
+			"keeping old member list\n", sp->name);
+		sp->buflen = 0;
+		return 0;
+	}
+
+	ng_clear(sp);
+	sp->buf[sp->buflen] = '\0';
+	for (line = sp->buf; (end = strchr(line, '\n')) != NULL; line = end+1) {
+		*end = '\0';
+		if ((domain = strchr(line, ' ')) == NULL)
+			continue;
+		*domain++ = '\0';
+		ng_add(sp, strcmp(line, "*")? line : NULL,
+			   strcmp(domain, "*")? domain : NULL);
+	}
+	sp->compiled = 1;
+	sp->buflen = 0;
+	Dprintf(D_AUTH, "netgroup %s has %u hosts%s\n", sp->name, sp->count,
+		sp->any_host? " and a wildcard" : "");
+	return 1;
+}
+
+static ng_set *
+ng_find(const char *netgroup)
+{
+	ng_set	*sp;
+
+	for (sp = ng_sets; sp != NULL; sp = sp->next) {
+		if (!strcmp(sp->name, netgroup))
+			return sp;
+	}
+	return NULL;
+}
+
+/*
+ * Expand a netgroup named in the exports file.
+ */
+void
+auth_netgroup_load(const char *netgroup)
+{
+	ng_set	*sp;
+
+	if (ng_find(netgroup) != NULL)
+		return;
+
+	sp = (ng_set *) xmalloc(sizeof(*sp));
+	memset(sp, 0, sizeof(*sp));
+	sp->name = xstrdup(netgroup);
+	sp->fd = -1;
+	sp->expires = time(NULL) + NG_REFRESH;
+	sp->compiled = ng_expand(sp);
+	sp->next = ng_sets;
+	ng_sets = sp;
+
+	if (sp->compiled)
+		Dprintf(D_AUTH, "netgroup %s has %u hosts%s\n", sp->name,
+			sp->count, sp->any_host? " and a wildcard" : "");
+	else
+		Dprintf(L_WARNING, "can't enumerate netgroup %s, "
+			"using innetgr\n", netgroup);
+}
+
+/*
+ * Start refreshes that are due, and pick up those that are done.
+ * Returns 1 if any netgroup got a new member list.
+ */
+int
+auth_netgroup_refresh(void)
+{
+	ng_set	*sp;
+	time_t	now = time(NULL);
+	int	changed = 0;
+
+	for (sp = ng_sets; sp != NULL; sp = sp->next) {
+		if (sp->pid != 0)
+			changed |= ng_collect(sp);
+		else if (now >= sp->expires)
+			ng_start(sp);
+	}
+	return changed;
+}
+
+/*
+ * Match a host against a netgroup. Like innetgr, we first try the
+ * full host name with any domain, then the name without its domain
+ * part in that domain.
+ */
+int
+auth_netgroup_match(const char *netgroup, const char *hostname)
+{
+	ng_set	*sp;
+	char	*dot;
+	int	match;
+
+	if ((sp = ng_find(netgroup)) == NULL || !sp->compiled) {
+		if (innetgr(netgroup, hostname, NULL, NULL))
+			return 1;
+		if ((dot = strchr(hostname, '.')) == NULL)
+			return 0;
+		*dot = '\0';
+		match = innetgr(netgroup, hostname, NULL, dot + 1);
+		*dot = '.';
+		return match;
+	}
+
+	if (sp->any_host || ng_lookup(sp, hostname, NULL))
+		return 1;
+	if ((dot = strchr(hostname, '.')) == NULL)
+		return 0;
+	*dot = '\0';
+	match = ng_lookup(sp, hostname, dot + 1);
+	*dot = '.';
+	return match;
+}
+
+/*
+ * Forget all netgroups when the exports are reloaded.
+ */
+void
+auth_netgroup_clear(void)
+{
+	ng_set	*sp;
+
+	while ((sp = ng_sets) != NULL) {
+		ng_sets = sp->next;
+		if (sp->pid != 0) {
+			kill(sp->pid, SIGKILL);
+			close(sp->fd);
+			waitpid(sp->pid, NULL, 0);
+		}
+		ng_clear(sp);
+		if (sp->buf != NULL)
+			free(sp->buf);
+		free(sp->name);
+		free(sp);
+	}
+}
+
+#endif /* HAVE_INNETGR */
@@ -0,0 +1,298 @@
+/*
+ * bcache.c	Cache of recently read file blocks.
+ *
+ *		When many clients read the same few files, or a client
+ *		retransmits a READ, we'd rather not go to the file system
+ *		again. READ data is therefore kept in blocks of BC_BLOCK
+ *		bytes, keyed by pseudo inode and block number. A block is
+ *		good as long as the file's mtime, ctime and size are those
+ *		it was read with; READ gets fresh attributes from auth_fh
+ *		anyway, so checking costs nothing. That's not so when the
+ *		attributes come from a READDIR prefetch, and then we don't
+ *		use the cache. Blocks of files modified within the current
+ *		second aren't cached, since a later change could leave the
+ *		times as they are.
+ *
+ *		When a client reads a file sequentially, the next few
+ *		blocks are read into the cache after the reply has gone
+ *		out, so the client doesn't wait for them. A single pread
+ *		covers several READs to come.
+ *
+ *		The access check is still done by opening the file (or
+ *		finding an fd of the same user in the fd cache) before
+ *		looking at the cache.
+ */
+
+#include "nfsd.h"
+
+#define BC_SHIFT	13
+#define BC_BLOCK	(1 << BC_SHIFT)		/* 8K			*/
+#define BC_HASH_MIN	64
+#define BC_PREFETCH	4			/* blocks read ahead	*/
+
+typedef struct bcblock {
+	struct bcblock *	hash_next;
+	struct bcblock *	lru_next;	/* most recently used first */
+	struct bcblock *	lru_prev;
+	psi_t			psi;
+	off_t			blkno;
+	time_t			mtime;
+	time_t			ctime;
+	off_t			size;
+	int			len;		/* < BC_BLOCK at end of file */
+	char			data[BC_BLOCK];
+} bcblock;
+
+int			bc_max = BC_DEFAULT_SIZE / BC_BLOCK;
+
+static bcblock **	bc_hash = NULL;
+static unsigned int	bc_hashsize = 0;	/* about one block per chain */
+static bcblock *	bc_head = NULL;
+static bcblock *	bc_tail = NULL;
+static int		bc_count = 0;
+
+/* The last READ, to tell sequential readers */
+static psi_t		bc_last_psi = 0;
+static off_t		bc_last_end = -1;
+
+/* Prefetch to do after the reply has been sent */
+static fhcache *	bc_pf_fhc = NULL;
+static int		bc_pf_fd;
+static off_t		bc_pf_offset;
+static char		bc_pf_buf[BC_PREFETCH * BC_BLOCK];
+
+#define bc_hashval(psi, blkno) \
+	(((psi) ^ ((unsigned long) (blkno) * 2654435761UL)) & (bc_hashsize - 1))
+
+static void
+bc_init(void)
+{
+	bc_hashsize = BC_HASH_MIN;
+	while (bc_hashsize < (unsigned int) bc_max)
+		bc_hashsize <<= 1;
+	bc_hash = (bcblock **) xmalloc(bc_hashsize * sizeof(bcblock *));
+	memset(bc_hash, 0, bc_hashsize * sizeof(bcblock *));
+}
+
+static bcblock **
+bc_lookup(psi_t psi, off_t blkno)
+{
+	bcblock	**bpp, *bp;
+
+	bpp = &bc_hash[bc_hashval(psi, blkno)];
+	while ((bp = *bpp) != NULL) {
+		if (bp->psi == psi && bp->blkno == blkno)
+			break;
+		bpp = &bp->hash_next;
+	}
+	return bpp;
+}
+
+static void
+bc_lru_unlink(bcblock *bp)
+{
+	if (bp->lru_prev != NULL)
+		bp->lru_prev->lru_next = bp->lru_next;
+	else
+		bc_head = bp->lru_next;
+	if (bp->lru_next != NULL)
+		bp->lru_next->lru_prev = bp->lru_prev;
+	else
+		bc_tail = bp->lru_prev;
+}
+
+static void
+bc_lru_insert(bcblock *bp)
+{
+	bp->lru_prev = NULL;
+	bp->lru_next = bc_head;
+	if (bc_head != NULL)
+		bc_head->lru_prev = bp;
+	else
+		bc_tail = bp;
+	bc_head = bp;
+}
+
+static int
+bc_valid(bcblock *bp, struct stat *sp)
+{
+	return (bp->mtime == sp->st_mtime && bp->ctime == sp->st_ctime
+		&& bp->size == sp->st_size);
+}
+
+/*
+ * Find a valid block. Stale ones are left for the LRU to recycle.
+ */
+static bcblock *
+bc_get(fhcache *fhc, off_t blkno)
+{
+	bcblock	*bp;
+
+	if ((bp = *bc_lookup(fhc->h.psi, blkno)) == NULL
+	 || !bc_valid(bp, &fhc->attrs))
+		return NULL;
+	if (bp != bc_head) {
+		bc_lru_unlink(bp);
+		bc_lru_insert(bp);
+	}
+	return bp;
+}
+
+/*
+ * Store a block, reusing the least recently used one if the cache
+ * is full.
+ */
+static void
+bc_put(fhcache *fhc, off_t blkno, char *data, int len)
+{
+	bcblock	**bpp, *bp;
+
+	bpp = bc_lookup(fhc->h.psi, blkno);
+	if ((bp = *bpp) != NULL) {
+		bc_lru_unlink(bp);
+	} else if (bc_count < bc_max) {
+		bp = (bcblock *) xmalloc(sizeof(*bp));
+		bc_count++;
+		bp->psi = fhc->h.psi;
+		bp->blkno = blkno;
+		bp->hash_next = *bpp;
+		*bpp = bp;
+	} else {
+		bp = bc_tail;
+		bc_lru_unlink(bp);
+		*bc_lookup(bp->psi, bp->blkno) = bp->hash_next;
+		bpp = bc_lookup(fhc->h.psi, blkno);
+		bp->psi = fhc->h.psi;
+		bp->blkno = blkno;
+		bp->hash_next = *bpp;
+		*bpp = bp;
+	}
+	bp->mtime = fhc->attrs.st_mtime;
+	bp->ctime = fhc->attrs.st_ctime;
+	bp->size = fhc->attrs.st_size;
+	bp->len = len;
+	memcpy(bp->data, data, len);
+	bc_lru_insert(bp);
+}
+
+/*
+ * Can we cache data of this file?
+ */
+static int
+bc_cacheable(fhcache *fhc)
+{
+	struct stat	*sp = &fhc->attrs;
+
+	return ((fhc->flags & FHC_ATTRVALID)
+		&& !(fhc->flags & FHC_ATTRCACHED) && S_ISREG(sp->st_mode)
+		&& sp->st_mtime < nfs_dispatch_time
+		&& sp->st_ctime < nfs_dispatch_time);
+}
+
+/*
+ * Put the whole blocks of what we have just read into the cache, and
+ * the partial one at the end of the file.
+ */
+static void
+bc_fill(fhcache *fhc, char *buf, size_t len, off_t offset)
+{
+	off_t	blkno, pos, end = offset + len;
+	int	n;
+
+	blkno = (offset + BC_BLOCK - 1) >> BC_SHIFT;
+	for (pos = blkno << BC_SHIFT; pos < end; pos += BC_BLOCK, blkno++) {
+		n = MIN(BC_BLOCK, end - pos);
+		if (n < BC_BLOCK && pos + n != fhc->attrs.st_size)
+			break;
+		bc_put(fhc, blkno, buf + (pos - offset), n);
+	}
+}
+
+/*
+ * Copy a range from the cache. Returns the number of bytes, or -1 if
+ * any part of it isn't cached.
+ */
+static int
+bc_copy(fhcache *fhc, char *buf, size_t len, off_t offset)
+{
+	off_t	pos, size = fhc->attrs.st_size;
+	size_t	done = 0, n, skip;
+	bcblock	*bp;
+
+	if (offset >= size)
+		return 0;
+	if (len > size - offset)
+		len = size - offset;
+	while (done < len) {
+		pos = offset + done;
+		if ((bp = bc_get(fhc, pos >> BC_SHIFT)) == NULL)
+			return -1;
+		skip = pos & (BC_BLOCK - 1);
+		if (skip >= (size_t) bp->len)
+			return -1;
+		n = MIN(len - done, bp->len - skip);
+		memcpy(buf + done, bp->data + skip, n);
+		done += n;
+	}
+	return done;
+}
+
+/*
+ * Read from a file through the cache.
+ */
+int
+bc_read(fhcache *fhc, int fd, char *buf, size_t len, off_t offset)
+{
+	off_t	end;
+	int	n;
+
+	if (bc_max == 0 || !bc_cacheable(fhc))
+		return fh_read(fhc, fd, buf, len, offset);
+	if (bc_hash == NULL)
+		bc_init();
+
+	if ((n = bc_copy(fhc, buf, len, offset)) >= 0) {
+		Dprintf(D_FHCACHE, "bc_read: %s hit %lu+%lu\n", fhc->path,
+			(unsigned long) offset, (unsigned long) len);
+	} else if ((n = fh_read(fhc, fd, buf, len, offset)) > 0) {
+		bc_fill(fhc, buf, n, offset);
+	}
+
+	/* Read ahead for sequential readers, unless we're at the end of
+	 * the file or have the next blocks already. */
+	if (n > 0) {
+		end = offset + n;
+		if (fhc->h.psi == bc_last_psi && offset <= bc_last_end
+		 && end > bc_last_end && end < fhc->attrs.st_size
+		 && bc_get(fhc, (end + BC_BLOCK - 1) >> BC_SHIFT) == NULL) {
+			bc_pf_fhc = fhc;
+			bc_pf_fd = fd;
+			bc_pf_offset = (end + BC_BLOCK - 1) & ~(off_t) (BC_BLOCK - 1);
+		}
+		bc_last_psi = fhc->h.psi;
+		bc_last_end = end;
+	}
+	return n;
+}
+
+/*
+ * Called by the dispatcher after sending the reply. Reads the blocks a
+ * sequential reader will want next. The fd is still good, since the
+ * cache isn't flushed while we're serving a request.
+ */
+void
+bc_prefetch(void)
+{
+	fhcache		*fhc = bc_pf_fhc;
+	int		n;
+
+	if (fhc == NULL)
+		return;
+	bc_pf_fhc = NULL;
+
+	n = fh_read(fhc, bc_pf_fd, bc_pf_buf, sizeof(bc_pf_buf), bc_pf_offset);
+	Dprintf(D_FHCACHE, "bc_prefetch: %s %d bytes at %lu\n", fhc->path,
+			n, (unsigned long) bc_pf_offset);
+	if (n > 0)
+		bc_fill(fhc, bc_pf_buf, n, bc_pf_offset);
+}
@@ -14,9 +14,10 @@
 #define efs_shutdown()		efs_noop
 #define efs_timeout_handler()	efs_noop
 
-/* Propagate changes of uid/gid */
-#define efs_setfsuid(u)		setfsuid(u)
-#define efs_setfsgid(g)		setfsgid(g)
+/* Propagate changes of uid/gid. nfsd switches its own ids right
+ * after calling these, so there's nothing to do by default. */
+#define efs_setfsuid(u)		efs_noop
+#define efs_setfsgid(g)		efs_noop
 
 /* VFS operations */
 #define efs_mkdir	mkdir
@@ -28,6 +29,10 @@
 #define efs_read	read
 #define efs_write	write
 #define efs_lseek	lseek
+#define efs_pread	pread
+#define efs_pwrite	pwrite
+#define efs_fdatasync	fdatasync
+#define efs_fsync	fsync
 
 #define efs_opendir	opendir
 #define efs_readdir	readdir
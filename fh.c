@@ -30,6 +30,14 @@
  *		    fh_remove (new, by Don Becker)
  *			delete the file handle associated with PATH from the
  *			cache
+ *		    fh_prefetch_entry
+ *			create a cache entry and fetch attributes for a
+ *			name returned by READDIR
+ *		    fh_rename
+ *			update cached paths after a rename
+ *		    fh_dir_modified
+ *			invalidate the name cache of a directory after
+ *			one of its entries was added or removed
  *
  * Authors:	Mark A. Shand, May 1988
  *		Donald J. Becker <becker@super.org>
@@ -50,6 +58,7 @@
  */
 
 #include <assert.h>
+#include <sys/resource.h>
 #include "nfsd.h"
 #include "rpcmisc.h"
 #include "signals.h"
@@ -88,12 +97,20 @@ static mutex			ex_state = inactive;
 static mutex			io_state = inactive;
 
 #define HASH_TAB_SIZE		256
+#define PATH_TAB_SIZE		512
 static fhcache			fh_head, fh_tail;
 static fhcache *		fh_hashed[HASH_TAB_SIZE];
-static fhcache *		fd_lru_head = NULL;
-static fhcache *		fd_lru_tail = NULL;
+static fhcache *		fh_pathhashed[PATH_TAB_SIZE];
+static fhfd *			fd_lru_head = NULL;
+static fhfd *			fd_lru_tail = NULL;
 static int			fh_list_size;
 static time_t			curtime;
+int				fh_prefetch = 0;
+int				fh_wb_max = WB_DEFAULT_MAX;
+int				fh_wb_interval = WB_DEFAULT_INTERVAL;
+static fhwb *			wb_head = NULL;
+static fhwb *			wb_tail = NULL;
+static int			wb_total = 0;
 
 #ifndef FOPEN_MAX
 #define FOPEN_MAX		256
@@ -104,8 +121,11 @@ static time_t			curtime;
 #define D_FHTRACE		D_FHCACHE
 #endif
 
-static fhcache *		fd_cache[FOPEN_MAX] = { NULL };
+static fhfd **			fd_cache = NULL;
+static int			fd_cache_max = 0;	/* size of fd_cache[] */
+static int			fd_cache_limit = FD_CACHE_LIMIT(FOPEN_MAX);
 static int			fd_cache_size = 0;
+static int			fd_cache_lowest = 0;	/* move fds above this */
 
 #ifndef NFSERR_INVAL			/* that Sun forgot */
 #define NFSERR_INVAL	22
@@ -142,9 +162,14 @@ struct {
 /* Forward declared local functions */
 static psi_t	path_psi(char *, nfsstat *, struct stat *, int);
 static int	fh_flush_fds(void);
+static int	path_open_how(char *, int, int, int *);
+static void	fh_perm_clear(fhcache *h);
 static char *	fh_dump(svc_fh *);
-static void	fh_insert_fdcache(fhcache *fhc);
-static void	fh_unlink_fdcache(fhcache *fhc);
+static void	fh_insert_fdcache(fhfd *fp);
+static void	fh_unlink_fdcache(fhfd *fp);
+static void	fh_close_fd(fhfd *fp);
+static void	fh_setpath(fhcache *fhc, char *path);
+static void	fh_dcache_flush(fhcache *dirh);
 
 static void
 fh_move_to_front(fhcache *fhc)
@@ -176,6 +201,11 @@ fh_inserthead(fhcache *fhc)
 	hash_slot = &(fh_hashed[fhc->h.psi % HASH_TAB_SIZE]);
 	fhc->hash_next = *hash_slot;
 	*hash_slot = fhc;
+
+	/* Insert into path hash tab (if we know the path already) */
+	fhc->path_next = NULL;
+	if (fhc->path != NULL)
+		fh_setpath(fhc, fhc->path);
 }
 
 static fhcache *
@@ -189,48 +219,207 @@ fh_lookup(psi_t psi)
 	return (fhc);
 }
 
+/*
+ * Secondary index of cached handles by path name. This lets us find
+ * the cache entry for a path without going through path_psi first.
+ */
+static inline unsigned int
+hash_path_name(const char *path)
+{
+	register unsigned int	h = 0;
+
+	while (*path)
+		h = h * 31 + (unsigned char) *path++;
+	return h % PATH_TAB_SIZE;
+}
+
+static fhcache *
+fh_lookup_path(const char *path)
+{
+	register fhcache *fhc;
+
+	fhc = fh_pathhashed[hash_path_name(path)];
+	while (fhc != NULL && strcmp(fhc->path, path) != 0)
+		fhc = fhc->path_next;
+	return (fhc);
+}
+
 static void
-fh_insert_fdcache(fhcache *fhc)
+fh_unhash_path(fhcache *fhc)
 {
-	if (fhc == fd_lru_head)
+	register fhcache **hash_slot;
+
+	if (fhc->path == NULL)
 		return;
-	if (fhc->fd_next || fhc->fd_prev)
-		fh_unlink_fdcache(fhc);
+	hash_slot = &(fh_pathhashed[hash_path_name(fhc->path)]);
+	while (*hash_slot != NULL && *hash_slot != fhc)
+		hash_slot = &((*hash_slot)->path_next);
+	if (*hash_slot != NULL)
+		*hash_slot = fhc->path_next;
+	fhc->path_next = NULL;
+}
+
+/*
+ * Set the path of a cache entry and enter it into the path hash.
+ * The path string must be malloc'ed; any previous path is freed.
+ */
+static void
+fh_setpath(fhcache *fhc, char *path)
+{
+	register fhcache **hash_slot;
+
+	if (fhc->path != NULL) {
+		fh_unhash_path(fhc);
+		if (fhc->path != path)
+			free(fhc->path);
+	}
+	fhc->path = path;
+	hash_slot = &(fh_pathhashed[hash_path_name(path)]);
+	fhc->path_next = *hash_slot;
+	*hash_slot = fhc;
+}
+
+/*
+ * Per-directory name cache. Entries are only valid for as long as the
+ * directory's mtime stays the same; we rely on the caller having just
+ * refreshed dirh->attrs (auth_fh does so through FHFIND_CHECK).
+ */
+static void
+fh_dcache_flush(fhcache *dirh)
+{
+	fh_dentry	*de;
+
+	while ((de = dirh->dcache) != NULL) {
+		dirh->dcache = de->next;
+		free(de);
+	}
+	dirh->dcache_size = 0;
+}
+
+static inline int
+fh_dcache_valid(fhcache *dirh)
+{
+	/* Attributes must have been fetched during this second. */
+	if (dirh->attr_time != curtime)
+		return 0;
+	if (dirh->dcache != NULL
+	 && dirh->dcache_mtime != dirh->attrs.st_mtime)
+		fh_dcache_flush(dirh);
+	return 1;
+}
+
+static fh_dentry *
+fh_dcache_lookup(fhcache *dirh, const char *name)
+{
+	fh_dentry	*de, **dep;
+
+	for (dep = &dirh->dcache; (de = *dep) != NULL; dep = &de->next) {
+		if (strcmp(de->name, name) == 0) {
+			/* Move to front */
+			*dep = de->next;
+			de->next = dirh->dcache;
+			dirh->dcache = de;
+			return de;
+		}
+	}
+	return NULL;
+}
+
+static void
+fh_dcache_enter(fhcache *dirh, const char *name, psi_t psi)
+{
+	fh_dentry	*de, **dep;
+
+	/* Don't cache anything while the directory may still change
+	 * within the same mtime second. */
+	if (curtime <= dirh->attrs.st_mtime)
+		return;
+
+	if (dirh->dcache == NULL)
+		dirh->dcache_mtime = dirh->attrs.st_mtime;
+
+	if ((de = fh_dcache_lookup(dirh, name)) != NULL) {
+		de->psi = psi;
+		return;
+	}
+
+	if (dirh->dcache_size >= DCACHE_MAX) {
+		/* Drop least recently used entry */
+		for (dep = &dirh->dcache; (*dep)->next; dep = &(*dep)->next)
+			;
+		free(*dep);
+		*dep = NULL;
+		dirh->dcache_size--;
+	}
+
+	de = (fh_dentry *) xmalloc(sizeof(*de) + strlen(name));
+	strcpy(de->name, name);
+	de->psi = psi;
+	de->next = dirh->dcache;
+	dirh->dcache = de;
+	dirh->dcache_size++;
+}
+
+/*
+ * Make sure fd_cache[] can be indexed by FD.
+ */
+static void
+fh_grow_fdcache(int fd)
+{
+	int	n = fd_cache_max ? fd_cache_max : FOPEN_MAX;
+
+	while (n <= fd)
+		n *= 2;
+	fd_cache = (fhfd **) xrealloc(fd_cache, n * sizeof(fhfd *));
+	memset(fd_cache + fd_cache_max, 0,
+			(n - fd_cache_max) * sizeof(fhfd *));
+	fd_cache_max = n;
+}
+
+static void
+fh_insert_fdcache(fhfd *fp)
+{
+	if (fp == fd_lru_head)
+		return;
+	if (fp->lru_next || fp->lru_prev)
+		fh_unlink_fdcache(fp);
+	if (fp->fd >= fd_cache_max)
+		fh_grow_fdcache(fp->fd);
 	if (fd_lru_head)
-		fd_lru_head->fd_prev = fhc;
+		fd_lru_head->lru_prev = fp;
 	else
-		fd_lru_tail = fhc;
-	fhc->fd_next = fd_lru_head;
-	fd_lru_head = fhc;
+		fd_lru_tail = fp;
+	fp->lru_next = fd_lru_head;
+	fd_lru_head = fp;
 
 #ifdef FHTRACE
-	if (fd_cache[fhc->fd] != NULL) {
+	if (fd_cache[fp->fd] != NULL) {
 		Dprintf(L_ERROR, "fd cache inconsistency!\n");
 		return;
 	}
 #endif
-	fd_cache[fhc->fd] = fhc;
+	fd_cache[fp->fd] = fp;
 	fd_cache_size++;
 }
 
 static void
-fh_unlink_fdcache(fhcache *fhc)
+fh_unlink_fdcache(fhfd *fp)
 {
-	fhcache	*prev = fhc->fd_prev,
-		*next = fhc->fd_next;
+	fhfd	*prev = fp->lru_prev,
+		*next = fp->lru_next;
 
-	fhc->fd_next = fhc->fd_prev = NULL;
+	fp->lru_next = fp->lru_prev = NULL;
 	if (next) {
-		next->fd_prev = prev;
-	} else if (fd_lru_tail == fhc) {
+		next->lru_prev = prev;
+	} else if (fd_lru_tail == fp) {
 		fd_lru_tail = prev;
 	} else {
 		Dprintf(L_ERROR, "fd cache inconsistency\n");
 		return;
 	}
 	if (prev) {
-		prev->fd_next = next;
-	} else if (fd_lru_head == fhc) {
+		prev->lru_next = next;
+	} else if (fd_lru_head == fp) {
 		fd_lru_head = next;
 	} else {
 		Dprintf(L_ERROR, "fd cache inconsistency\n");
@@ -238,26 +427,85 @@ fh_unlink_fdcache(fhcache *fhc)
 	}
 
 #ifdef FHTRACE
-	if (fd_cache[fhc->fd] != fhc) {
+	if (fd_cache[fp->fd] != fp) {
 		Dprintf(L_ERROR, "fd cache inconsistency!\n");
 		return;
 	}
 #endif
-	fd_cache[fhc->fd] = NULL;
+	fd_cache[fp->fd] = NULL;
 	fd_cache_size--;
 }
 
+/*
+ * Add an open file descriptor to the handle's list. We keep only one
+ * descriptor per uid and access mode, and at most FH_FD_LIMIT in all.
+ */
+static int
+fh_add_fd(fhcache *fhc, int fd, int omode)
+{
+	fhfd	*fp, *next;
+	int	newfd;
+
+	/* Keep the descriptors below FD_SETSIZE free for sockets;
+	 * the RPC library selects on those. */
+	if (fd < fd_cache_lowest
+	 && (newfd = fcntl(fd, F_DUPFD, fd_cache_lowest)) >= 0) {
+		efs_close(fd);
+		fd = newfd;
+	}
+
+	omode &= O_ACCMODE;
+	for (fp = fhc->fds; fp != NULL; fp = next) {
+		next = fp->next;
+		if (fp->uid == auth_uid && fp->omode == omode)
+			fh_close_fd(fp);
+	}
+	if (fhc->nfds >= FH_FD_LIMIT) {
+		for (fp = fhc->fds; fp->next != NULL; fp = fp->next)
+			;
+		fh_close_fd(fp);
+	}
+
+	fp = (fhfd *) xmalloc(sizeof(*fp));
+	fp->fhc = fhc;
+	fp->fd = fd;
+	fp->omode = omode;
+	fp->uid = auth_uid;
+	fp->last_used = curtime;
+	fp->seq_start = fp->seq_next = fp->ra_end = fp->drop_end = 0;
+	fp->seq_count = 0;
+	fp->lru_next = fp->lru_prev = NULL;
+	fp->next = fhc->fds;
+	fhc->fds = fp;
+	fhc->nfds++;
+	fh_insert_fdcache(fp);
+	return fd;
+}
+
+static void
+fh_close_fd(fhfd *fp)
+{
+	fhcache	*fhc = fp->fhc;
+	fhfd	**fpp;
+
+	Dprintf(D_FHCACHE,
+		"fh_close: closing handle %x ('%s', fd=%d)\n",
+		fhc, fhc->path ? fhc->path : "<unnamed>", fp->fd);
+	for (fpp = &fhc->fds; *fpp != NULL && *fpp != fp; fpp = &(*fpp)->next)
+		;
+	if (*fpp != NULL)
+		*fpp = fp->next;
+	fhc->nfds--;
+	fh_unlink_fdcache(fp);
+	efs_close(fp->fd);
+	free(fp);
+}
+
 static void
 fh_close(fhcache *fhc)
 {
-	if (fhc->fd >= 0) {
-		Dprintf(D_FHCACHE,
-			"fh_close: closing handle %x ('%s', fd=%d)\n",
-			fhc, fhc->path ? fhc->path : "<unnamed>", fhc->fd);
-		fh_unlink_fdcache(fhc);
-		efs_close(fhc->fd);
-		fhc->fd = -1;
-	}
+	while (fhc->fds != NULL)
+		fh_close_fd(fhc->fds);
 }
 
 static void
@@ -271,8 +519,8 @@ fh_delete(fhcache *fhc)
 #endif
 
 	Dprintf(D_FHTRACE|D_FHCACHE,
-		"fh_delete: deleting handle %x ('%s', fd=%d)\n",
-		fhc, fhc->path ? fhc->path : "<unnamed>", fhc->fd);
+		"fh_delete: deleting handle %x ('%s', fds=%d)\n",
+		fhc, fhc->path ? fhc->path : "<unnamed>", fhc->nfds);
 
 	/* Remove from current posn */
 	fhc->prev->next = fhc->next;
@@ -290,11 +538,16 @@ fh_delete(fhcache *fhc)
 	else
 		*hash_slot = fhc->hash_next;
 
+	fh_wb_flush(fhc);
 	fh_close(fhc);
+	fh_dcache_flush(fhc);
+	fh_perm_clear(fhc);
 
 	/* Free storage. */
-	if (fhc->path != NULL)
+	if (fhc->path != NULL) {
+		fh_unhash_path(fhc);
 		free(fhc->path);
+	}
 
 #ifdef FHTRACE
 	/* Safeguard against cache corruption */
@@ -751,6 +1004,11 @@ path_psi(char *path, nfsstat *status, struct stat *sbp, int svalid)
 		struct stat ddbuf;
 		char *fname;
 
+		/* The mount table usually knows, which saves us the
+		 * lstat of the parent and the readdir scan. */
+		if (mnt_covered(path, sbp) != MNT_UNKNOWN)
+			goto unreadable;
+
 		/* Find start of last component of path. */
 #if 1
 		char	*dname = path;
@@ -783,6 +1041,7 @@ path_psi(char *path, nfsstat *status, struct stat *sbp, int svalid)
 		/* fname now points to directory entry name. */
 		if (ddbuf.st_dev == sbp->st_dev) {
 			fname[-1] = '/';	/* Restore path */
+			mnt_set_covered(path, sbp, sbp->st_dev, sbp->st_ino);
 		} else {
 			/* Directory is a mount point. */
 			DIR *dirp;
@@ -808,6 +1067,8 @@ path_psi(char *path, nfsstat *status, struct stat *sbp, int svalid)
 						return (0);
 					}
 				} while (strcmp(fname, dp->d_name) != 0);
+				mnt_set_covered(path, sbp, ddbuf.st_dev,
+							dp->d_ino);
 				sbp->st_dev = ddbuf.st_dev;
 				sbp->st_ino = dp->d_ino;
 				efs_closedir(dirp);
@@ -838,13 +1099,13 @@ fh_find(svc_fh *h, int mode)
 	ex_state = active;
 	time(&curtime);
 	while ((fhc = fh_lookup(h->psi)) != NULL) {
-		Dprintf(D_FHCACHE, "fh_find: psi=%lx... found '%s', fd=%d\n",
+		Dprintf(D_FHCACHE, "fh_find: psi=%lx... found '%s', fds=%d\n",
 			(unsigned long) h->psi,
 			fhc->path ? fhc->path : "<unnamed>",
-			fhc->fd);
+			fhc->nfds);
 
 		/* Invalidate cached attrs */
-		fhc->flags &= ~FHC_ATTRVALID;
+		fhc->flags &= ~(FHC_ATTRVALID | FHC_ATTRCACHED);
 
 		/* But what if hash_paths are not the same?
 		 * Something is stale. */
@@ -861,11 +1122,23 @@ fh_find(svc_fh *h, int mode)
 			psi_t		psi;
 			nfsstat		dummy;
 
+			/* Attributes prefetched by a recent READDIR are
+			 * good for exactly one check. */
+			if (fhc->flags & FHC_PREFETCHED) {
+				fhc->flags &= ~FHC_PREFETCHED;
+				if (curtime - fhc->attr_time <= PREFETCH_TTL) {
+					fhc->flags |= FHC_ATTRVALID
+							| FHC_ATTRCACHED;
+					goto fh_return;
+				}
+			}
+
 			if (efs_lstat(fhc->path, s) < 0) {
 				Dprintf(D_FHTRACE,
 					"fh_find: stale fh: lstat: %m\n");
 			} else {
 				fhc->flags |= FHC_ATTRVALID;
+				fhc->attr_time = curtime;
 				/* If pseudo-inos don't match, we fhc->path
 				 * may be a mount point (hence lstat() returns
 				 * a different inode number than the readdir()
@@ -938,18 +1211,25 @@ fh_find(svc_fh *h, int mode)
 		fhc->path = path;
 	}
 	fhc->flags = 0;
+	fhc->attr_time = 0;
 	if (fhc->path && efs_lstat(fhc->path, &fhc->attrs) >= 0) {
 		if (re_export && nfsmounted(fhc->path, &fhc->attrs))
 			fhc->flags |= FHC_NFSMOUNTED;
 		fhc->flags |= FHC_ATTRVALID;
+		fhc->attr_time = curtime;
 	}
-	fhc->fd = -1;
+	fhc->fds = NULL;
+	fhc->nfds = 0;
+	fhc->perms = NULL;
+	fhc->nperms = 0;
+	fhc->wb = NULL;
+	fhc->wb_error = 0;
+	fhc->ext.start = fhc->ext.end = 0;
 	fhc->last_used = curtime;
 	fhc->h = *h;
-	fhc->last_clnt = NULL;
-	fhc->last_mount = NULL;
-	fhc->last_uid = (uid_t)-1;
-	fhc->fd_next = fhc->fd_prev = NULL;
+	fhc->nauth = 0;
+	fhc->dcache = NULL;
+	fhc->dcache_size = 0;
 	fh_inserthead(fhc);
 	Dprintf(D_FHCACHE,
 		"fh_find: created new handle %x (path `%s' psi %08x)\n",
@@ -1037,8 +1317,7 @@ fh_create(nfs_fh *fh, char *path)
 
 	/* assert(h != NULL); */
 	if (h->path == NULL) {
-		h->fd = -1;
-		h->path = xstrdup(path);
+		fh_setpath(h, xstrdup(path));
 		h->flags = 0;
 	}
 	memcpy(fh, &key, sizeof(key));
@@ -1066,11 +1345,25 @@ fh_handle(fhcache *h)
 
 int
 path_open(char *path, int omode, int perm)
+{
+	int	how;
+
+	return path_open_how(path, omode, perm, &how);
+}
+
+/*
+ * Open a file on behalf of the current user. On return, HOW tells
+ * which way access was decided (one of the PERM_* values, or 0 if the
+ * open failed for some other reason than permissions).
+ */
+static int
+path_open_how(char *path, int omode, int perm, int *how)
 {
 	int fd;
 	int oerrno, ok;
 	struct stat buf;
 
+	*how = 0;
 	fh_flush_fds();
 
 	/* If the file exists, make sure it is a regular file. Opening
@@ -1085,6 +1378,8 @@ path_open(char *path, int omode, int perm)
 
 #if 1
 	fd = efs_open(path, omode, perm);
+	if (fd >= 0)
+		*how = PERM_DIRECT;
 #else
 	/* First, try to open the file read/write. The O_*ONLY flags ored
 	 * together do not yield O_RDWR, unfortunately. 
@@ -1135,10 +1430,14 @@ path_open(char *path, int omode, int perm)
 			fd = efs_open(path, omode, perm);
 			oerrno = errno;
 			auth_override_uid(auth_uid);
+			if (fd >= 0)
+				*how = PERM_OVERRIDE;
 		}
 	}
 
 	if (fd < 0) {
+		if (oerrno == EACCES)
+			*how = PERM_DENIED;
 		Dprintf(D_FHCACHE,
 			"path_open(%s, %o, %o): failure mode 2, err=%d, oerr=%d\n",
 			path, omode, perm, errno, oerrno);
@@ -1150,39 +1449,214 @@ path_open(char *path, int omode, int perm)
 	return (fd);
 }
 
+/*
+ * Access decision cache for fh_open.
+ */
+static fhperm *
+fh_perm_lookup(fhcache *h, int omode)
+{
+	fhperm	*pp, **ppp;
+	int	ngids = auth_gidlen > 0 ? auth_gidlen : 0;
+
+	for (ppp = &h->perms; (pp = *ppp) != NULL; ppp = &pp->next) {
+		if (pp->omode != omode || pp->uid != auth_uid
+		 || pp->gid != auth_gid || pp->ngids != ngids
+		 || memcmp(pp->gids, auth_gids, ngids * sizeof(GETGROUPS_T)))
+			continue;
+		if (pp->f_uid != h->attrs.st_uid
+		 || pp->f_gid != h->attrs.st_gid
+		 || pp->f_mode != h->attrs.st_mode
+		 || ((pp->access == PERM_DENIED || omode == FH_PERM_SEARCH)
+		  && curtime - pp->when > PERM_DENY_TTL)) {
+			*ppp = pp->next;
+			free(pp);
+			h->nperms--;
+			return NULL;
+		}
+		return pp;
+	}
+	return NULL;
+}
+
+static void
+fh_perm_enter(fhcache *h, int omode, int access)
+{
+	fhperm	*pp, **ppp;
+	int	ngids = auth_gidlen > 0 ? auth_gidlen : 0;
+
+	if (h->nperms >= FH_PERM_LIMIT) {
+		for (ppp = &h->perms; (*ppp)->next != NULL; ppp = &(*ppp)->next)
+			;
+		free(*ppp);
+		*ppp = NULL;
+		h->nperms--;
+	}
+	pp = (fhperm *) xmalloc(sizeof(*pp));
+	pp->uid = auth_uid;
+	pp->gid = auth_gid;
+	pp->ngids = ngids;
+	memcpy(pp->gids, auth_gids, ngids * sizeof(GETGROUPS_T));
+	pp->omode = omode;
+	pp->access = access;
+	pp->f_uid = h->attrs.st_uid;
+	pp->f_gid = h->attrs.st_gid;
+	pp->f_mode = h->attrs.st_mode;
+	pp->when = curtime;
+	pp->next = h->perms;
+	h->perms = pp;
+	h->nperms++;
+}
+
+static void
+fh_perm_clear(fhcache *h)
+{
+	fhperm	*pp;
+
+	while ((pp = h->perms) != NULL) {
+		h->perms = pp->next;
+		free(pp);
+	}
+	h->nperms = 0;
+}
+
+/*
+ * Called when the owner or mode of a file has been changed. Forget
+ * what we know about who may open it, and close any descriptors that
+ * were opened under the old permissions.
+ */
+void
+fh_perm_flush(fhcache *h)
+{
+	fh_perm_clear(h);
+	fh_close(h);
+}
+
+/*
+ * May the current user look up names in a directory? Lookups answered
+ * from a READDIR prefetch or from the name cache skip the lstat that
+ * would tell, and both are shared by all users. Stat'ing "dir/." takes
+ * the same permissions. Since an ACL change or one of a parent
+ * directory doesn't show in the directory's attributes, the answer is
+ * kept for PERM_DENY_TTL seconds only, whichever it is.
+ */
+static int
+fh_may_search(fhcache *dirh)
+{
+	fhperm		*pp;
+	struct stat	sbuf;
+	char		pathbuf[NFS_MAXPATHLEN + 3];
+	int		access;
+
+	if (!(dirh->flags & FHC_ATTRVALID) || !S_ISDIR(dirh->attrs.st_mode)
+	 || dirh->path == NULL || strlen(dirh->path) + 3 > sizeof(pathbuf))
+		return 0;
+	if ((pp = fh_perm_lookup(dirh, FH_PERM_SEARCH)) != NULL)
+		return (pp->access == PERM_DIRECT);
+
+	sprintf(pathbuf, "%s/.", dirh->path);
+	if (efs_lstat(pathbuf, &sbuf) >= 0)
+		access = PERM_DIRECT;
+	else if (errno == EACCES)
+		access = PERM_DENIED;
+	else
+		return 0;
+	Dprintf(D_FHCACHE, "fh_may_search: %s access %d for uid %d\n",
+			dirh->path, access, auth_uid);
+	fh_perm_enter(dirh, FH_PERM_SEARCH, access);
+	return (access == PERM_DIRECT);
+}
+
+/*
+ * Open the file for a handle. If we have just fetched its attributes,
+ * we can skip the checks in path_open and go straight for the open
+ * that worked last time for this user.
+ */
+static int
+fh_open(fhcache *h, int omode)
+{
+	fhperm	*pp;
+	int	fd, how, oerrno;
+
+	if (!(h->flags & FHC_ATTRVALID) || !S_ISREG(h->attrs.st_mode)
+	 || (omode & (O_CREAT|O_TRUNC)))
+		return path_open(h->path, omode, 0);
+
+	if ((pp = fh_perm_lookup(h, omode)) != NULL) {
+		Dprintf(D_FHCACHE, "fh_open: cached access %d for uid %d\n",
+				pp->access, auth_uid);
+		fh_flush_fds();
+		switch (pp->access) {
+		case PERM_DENIED:
+			errno = EACCES;
+			return -1;
+		case PERM_DIRECT:
+			fd = efs_open(h->path, omode, 0);
+			break;
+		case PERM_OVERRIDE:
+		default:
+			auth_override_uid(ROOT_UID);
+			fd = efs_open(h->path, omode, 0);
+			oerrno = errno;
+			auth_override_uid(auth_uid);
+			errno = oerrno;
+			break;
+		}
+		if (fd >= 0 || errno != EACCES)
+			return fd;
+		/* Something changed behind our back */
+		fh_perm_clear(h);
+	}
+
+	fd = path_open_how(h->path, omode, 0, &how);
+	if (how != 0) {
+		oerrno = errno;
+		fh_perm_enter(h, omode, how);
+		errno = oerrno;
+	}
+	return fd;
+}
+
 int
 fh_fd(fhcache *h, nfsstat *status, int omode)
 {
-	if (h->fd >= 0) {
-		/* If the requester's uid doesn't match that of the user who
-		 * opened the file, we close the file. I guess we could work
-		 * some magic with the eaccess stuff, but I don't know if
-		 * this would be any faster than simply re-doing the open.
-		 */
-		if (h->last_uid == auth_uid && (h->omode == omode ||
-		    ((omode == O_RDONLY || omode == O_WRONLY) && h->omode == O_RDWR))) {
-			Dprintf(D_FHCACHE, "fh_fd: reusing fd=%d\n", h->fd);
-			fh_insert_fdcache(h);	/* move to front of fd LRU */
-			return (h->fd);
+	fhfd	*fp, **fpp;
+	int	fd;
+
+	/* Look for a descriptor opened by the same user with a suitable
+	 * access mode. We could work some magic with the eaccess stuff
+	 * to share descriptors between users, but I don't know if this
+	 * would be any faster than simply doing another open.
+	 */
+	for (fpp = &h->fds; (fp = *fpp) != NULL; fpp = &fp->next) {
+		if (fp->uid == auth_uid && (fp->omode == omode ||
+		    ((omode == O_RDONLY || omode == O_WRONLY) && fp->omode == O_RDWR))) {
+			Dprintf(D_FHCACHE, "fh_fd: reusing fd=%d\n", fp->fd);
+			/* move to front of handle's list and of fd LRU */
+			*fpp = fp->next;
+			fp->next = h->fds;
+			h->fds = fp;
+			fh_insert_fdcache(fp);
+			fp->last_used = curtime;
+			io_state = active;
+			return (fp->fd);
 		}
-		Dprintf(D_FHCACHE,
-		    "fh_fd: uid/omode mismatch (%d/%d wanted, %d/%d cached)\n",
-		     auth_uid, omode, h->last_uid, h->omode);
-		fh_close(h);
 	}
+	if (h->fds != NULL)
+		Dprintf(D_FHCACHE,
+		    "fh_fd: no fd for uid/omode %d/%d (%d cached)\n",
+		     auth_uid, omode, h->nfds);
+
 	errno = 0;
 	if (!h->path) {
 		*status = NFSERR_STALE;
 		return (-1);	/* something is really hosed */
 	}
 
-	if ((h->fd = path_open(h->path, omode, 0)) >= 0) {
+	if ((fd = fh_open(h, omode)) >= 0) {
 		io_state = active;
-		h->omode = omode & O_ACCMODE;
-		fh_insert_fdcache(h);
-		Dprintf(D_FHCACHE, "fh_fd: new open as fd=%d\n", h->fd);
-		h->last_uid = auth_uid;
-		return (h->fd);
+		fd = fh_add_fd(h, fd, omode);
+		Dprintf(D_FHCACHE, "fh_fd: new open as fd=%d\n", fd);
+		return (fd);
 	} 
 	*status = nfs_errno();
 	return -1;
@@ -1238,8 +1712,9 @@ fh_compose(diropargs *dopa, nfs_fh *new_fh, struct stat *sbp,
 {
 	svc_fh		*key;
 	fhcache		*dirh, *h;
+	fh_dentry	*de;
 	char		*sindx;
-	int		is_dd;
+	int		is_dd, use_dcache;
 	nfsstat		ret;
 	struct stat	sbuf;
 	char		pathbuf[PATH_MAX + NAME_MAX + 1], *fname;
@@ -1318,8 +1793,68 @@ fh_compose(diropargs *dopa, nfs_fh *new_fh, struct stat *sbp,
 
 	*new_fh = dopa->dir;
 	key = (svc_fh *) new_fh;
-	if ((key->psi = path_psi(pathbuf, &ret, sbp, 0)) == 0)
+
+	/* If a READDIR has just prefetched this entry, use the cached
+	 * handle and attributes rather than going through path_psi.
+	 * The READDIR may have come from another user, so check that
+	 * this one may search the directory. */
+	if (!is_dd && fd < 0 && omode < 0
+	 && (h = fh_lookup_path(pathbuf)) != NULL
+	 && (h->flags & FHC_PREFETCHED)
+	 && time(&curtime) - h->attr_time <= PREFETCH_TTL
+	 && key->hash_path[0] + 1 < HP_LEN
+	 && fh_may_search(dirh)) {
+		key->hash_path[++(key->hash_path[0])] = hash_psi(dirh->h.psi);
+		key->psi = h->h.psi;
+		if (memcmp(key, &h->h, sizeof(svc_fh)) == 0) {
+			Dprintf(D_FHCACHE,
+				"fh_compose: prefetched handle %x ('%s')\n",
+				h, h->path);
+			*sbp = h->attrs;
+			return (NFS_OK);
+		}
+		*new_fh = dopa->dir;
+	}
+
+	/* Consult the directory's name cache. Negative entries are
+	 * answered right away; positive ones only if the handle is
+	 * still cached under the same path. The caller will have to
+	 * stat the file itself (st_nlink == 0). As the cache is shared
+	 * by all users, only those who may search the directory get to
+	 * use it.
+	 */
+	use_dcache = (!public && !is_dd && fd < 0 && omode < 0
+			&& fh_dcache_valid(dirh) && fh_may_search(dirh));
+	if (use_dcache && (de = fh_dcache_lookup(dirh, fname)) != NULL) {
+		if (de->psi == 0) {
+			Dprintf(D_FHCACHE, "fh_compose: negative hit '%s'\n",
+				pathbuf);
+			return NFSERR_NOENT;
+		}
+		if (key->hash_path[0] + 1 < HP_LEN
+		 && (h = fh_lookup(de->psi)) != NULL
+		 && h->path != NULL && !strcmp(h->path, pathbuf)) {
+			key->hash_path[++(key->hash_path[0])] =
+						hash_psi(dirh->h.psi);
+			key->psi = de->psi;
+			if (memcmp(key, &h->h, sizeof(svc_fh)) == 0) {
+				Dprintf(D_FHCACHE,
+					"fh_compose: name cache hit %x ('%s')\n",
+					h, h->path);
+				sbp->st_nlink = 0;
+				return (NFS_OK);
+			}
+			*new_fh = dopa->dir;
+		}
+	}
+
+	if ((key->psi = path_psi(pathbuf, &ret, sbp, 0)) == 0) {
+		if (use_dcache && ret == NFSERR_NOENT)
+			fh_dcache_enter(dirh, fname, 0);
 		return (ret);
+	}
+	if (use_dcache)
+		fh_dcache_enter(dirh, fname, key->psi);
 
 	if (is_dd) {
 		/* Don't cd .. from root, or mysterious ailments will
@@ -1359,13 +1894,13 @@ fh_compose(diropargs *dopa, nfs_fh *new_fh, struct stat *sbp,
 			Dprintf(L_ERROR, "Internal inconsistency: double entry (path '%s', now '%s').\n",
 				h->path, pathbuf);
 	}
-	Dprintf(D_FHCACHE, "fh_compose: using  handle %x ('%s', fd=%d)\n",
-		h, h->path ? h->path : "<unnamed>", h->fd);
+	Dprintf(D_FHCACHE, "fh_compose: using  handle %x ('%s', fds=%d)\n",
+		h, h->path ? h->path : "<unnamed>", h->nfds);
 	/* End of new code */
 
 	/* assert(h != NULL); */
 	if (h->path == 0) {
-		h->path = xstrdup(pathbuf);
+		fh_setpath(h, xstrdup(pathbuf));
 		h->flags = 0;
 		if (!re_export && nfsmounted(pathbuf, sbp))
 			h->flags |= FHC_NFSMOUNTED;
@@ -1374,25 +1909,16 @@ fh_compose(diropargs *dopa, nfs_fh *new_fh, struct stat *sbp,
 		Dprintf(D_FHTRACE, "\tdata: %s\n", fh_dump(&h->h));
 #else
 		Dprintf(D_FHCACHE,
-			"fh_compose: +using  handle %x ('%s', fd=%d)\n",
-			h, h->path, h->fd);
+			"fh_compose: +using  handle %x ('%s', fds=%d)\n",
+			h, h->path, h->nfds);
 #endif
 	}
 
 	if (fd >= 0) {
 		Dprintf(D_FHCACHE,
 			"fh_compose: handle %x using passed fd %d\n", h, fd);
-		if (h->fd >= 0)
-			fh_close(h);
-		h->last_uid = auth_uid;
-		h->fd = fd;
-		fh_insert_fdcache(h);
-		Dprintf(D_FHCACHE,
-			"fh_compose: +using  handle %x ('%s', fd=%d)\n",
-			h, h->path ? h->path : "<unnamed>", h->fd);
+		(void) fh_add_fd(h, fd, omode);
 	}
-	if (omode >= 0)
-		h->omode = omode & O_ACCMODE;
 	return (NFS_OK);
 }
 
@@ -1422,6 +1948,517 @@ fh_remove(char *path)
 	return;
 }
 
+/*
+ * Find the cached handle of the directory containing PATH.
+ */
+static fhcache *
+fh_parent(char *path)
+{
+	char	*sp;
+	fhcache	*dirh;
+
+	if ((sp = strrchr(path, '/')) == NULL)
+		return NULL;
+	if (sp == path)
+		return fh_lookup_path("/");
+	*sp = '\0';
+	dirh = fh_lookup_path(path);
+	*sp = '/';
+	return dirh;
+}
+
+/*
+ * Give a handle moved from directory FROMDIR to TODIR the hash_path
+ * fh_compose would build for it now. Returns 0 if that can't be done.
+ */
+static int
+fh_move_hash_path(fhcache *fhc, fhcache *fromdir, fhcache *todir)
+{
+	__u8		hp[HP_LEN];
+	unsigned int	oldlen = fromdir->h.hash_path[0] + 1;
+	unsigned int	newlen = todir->h.hash_path[0] + 1;
+	unsigned int	depth = fhc->h.hash_path[0];
+
+	/* The old prefix is FROMDIR's hash_path plus FROMDIR itself */
+	if (oldlen >= HP_LEN || newlen >= HP_LEN || depth < oldlen
+	 || memcmp(fhc->h.hash_path + 1, fromdir->h.hash_path + 1, oldlen - 1)
+	 || fhc->h.hash_path[oldlen] != hash_psi(fromdir->h.psi))
+		return 0;
+	if (depth - oldlen + newlen >= HP_LEN)
+		return 0;
+
+	memset(hp, 0, sizeof(hp));
+	hp[0] = depth - oldlen + newlen;
+	memcpy(hp + 1, todir->h.hash_path + 1, newlen - 1);
+	hp[newlen] = hash_psi(todir->h.psi);
+	memcpy(hp + newlen + 1, fhc->h.hash_path + oldlen + 1, depth - oldlen);
+	memcpy(fhc->h.hash_path, hp, HP_LEN);
+	return 1;
+}
+
+/*
+ * A file or directory has been renamed. Give its cache entry, and
+ * those of any cached descendants, the new path instead of letting
+ * them go stale and having fh_buildpath search for them later.
+ *
+ * When it moves to another directory, the ancestors encoded in the
+ * hash_path change as well; handles that we can't fix up are dropped.
+ * Either way, handles clients got before the move go stale, as they
+ * always did.
+ */
+void
+fh_rename(char *from, char *to)
+{
+	fhcache	*fhc, *next, *fromdir = NULL, *todir = NULL;
+	size_t	flen = strlen(from), tlen = strlen(to), len;
+	char	*path, *fs, *ts;
+	int	count = 0, dropped = 0, moved;
+
+	fs = strrchr(from, '/');
+	ts = strrchr(to, '/');
+	moved = (fs == NULL || ts == NULL || fs - from != ts - to
+		 || strncmp(from, to, fs - from) != 0);
+	if (moved) {
+		fromdir = fh_parent(from);
+		todir = fh_parent(to);
+	}
+
+	ex_state = active;
+	for (fhc = fh_head.next; fhc != &fh_tail; fhc = next) {
+		next = fhc->next;
+		if (fhc->path == NULL || strncmp(fhc->path, from, flen) != 0)
+			continue;
+		if (fhc->path[flen] != '\0' && fhc->path[flen] != '/')
+			continue;
+		if (moved && (fromdir == NULL || todir == NULL
+			   || !fh_move_hash_path(fhc, fromdir, todir))) {
+			fh_delete(fhc);
+			dropped++;
+			continue;
+		}
+		if (fhc->path[flen] == '\0') {
+			/* The ctime of the renamed file changes */
+			fhc->flags &= ~(FHC_ATTRVALID | FHC_PREFETCHED);
+			path = xstrdup(to);
+		} else {
+			len = strlen(fhc->path + flen);
+			path = (char *) xmalloc(tlen + len + 1);
+			memcpy(path, to, tlen);
+			memcpy(path + tlen, fhc->path + flen, len + 1);
+		}
+		fh_setpath(fhc, path);
+		count++;
+	}
+	ex_state = inactive;
+
+	Dprintf(D_FHCACHE, "fh_rename: %s -> %s, %d handle(s) updated, "
+				"%d dropped\n", from, to, count, dropped);
+}
+
+/*
+ * Called whenever we add or remove a directory entry. Forget whatever
+ * we know about the names in the parent directory of PATH, and make
+ * sure its cached attributes aren't trusted until they're refreshed.
+ */
+void
+fh_dir_modified(char *path)
+{
+	fhcache	*dirh;
+
+	if ((dirh = fh_parent(path)) != NULL) {
+		fh_dcache_flush(dirh);
+		dirh->flags &= ~(FHC_ATTRVALID | FHC_PREFETCHED);
+		dirh->attr_time = 0;
+	}
+}
+
+/*
+ * Prefetch handle and attributes for a directory entry returned by
+ * READDIR. Clients usually follow up with a LOOKUP for every name
+ * (think `ls -l'), which can then be answered from the cache.
+ *
+ * The pseudo inode is computed from the readdir inode number just
+ * like path_psi does for mount points, so we need not stat the file
+ * to build its handle. The attributes are fetched relative to the
+ * open directory, which saves the kernel a full path walk per name.
+ */
+void
+fh_prefetch_entry(fhcache *dirh, int dirfd, char *name, ino_t ino, dev_t dev)
+{
+	char		pathbuf[PATH_MAX + NAME_MAX + 1];
+	struct stat	sbuf;
+	svc_fh		key;
+	fhcache		*h;
+	int		len;
+
+	if (!fh_prefetch || fh_list_size >= FH_CACHE_LIMIT - PREFETCH_MAX)
+		return;
+	if (name[0] == '.'
+	 && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+		return;
+
+	len = strlen(dirh->path);
+	if (len && dirh->path[len - 1] == '/')
+		len--;
+	if (len + strlen(name) + 1 >= NFS_MAXPATHLEN)
+		return;
+	memcpy(pathbuf, dirh->path, len);
+	pathbuf[len] = '/';
+	strcpy(pathbuf + len + 1, name);
+
+	key = dirh->h;
+	if (++(key.hash_path[0]) >= HP_LEN)
+		return;
+	key.hash_path[key.hash_path[0]] = hash_psi(dirh->h.psi);
+	key.psi = pseudo_inode(ino, dev);
+
+	/* Don't disturb an existing entry that has a different path */
+	if ((h = fh_lookup(key.psi)) != NULL
+	 && (h->path == NULL || strcmp(h->path, pathbuf) != 0
+	  || memcmp(&h->h, &key, sizeof(key)) != 0))
+		return;
+
+#ifdef AT_SYMLINK_NOFOLLOW
+	if (fstatat(dirfd, name, &sbuf, AT_SYMLINK_NOFOLLOW) < 0)
+		return;
+#else
+	if (efs_lstat(pathbuf, &sbuf) < 0)
+		return;
+#endif
+	/* Mount point: report the covered inode, as path_psi does */
+	if (S_ISDIR(sbuf.st_mode) && sbuf.st_dev != dev) {
+		sbuf.st_dev = dev;
+		sbuf.st_ino = ino;
+	}
+	if (pseudo_inode(sbuf.st_ino, sbuf.st_dev) != key.psi)
+		return;
+
+	if (h == NULL) {
+		if ((h = fh_find(&key, FHFIND_FCREATE)) == NULL)
+			return;
+		if (h->path == NULL) {
+			fh_setpath(h, xstrdup(pathbuf));
+			h->flags = 0;
+			if (!re_export && nfsmounted(pathbuf, &sbuf))
+				h->flags |= FHC_NFSMOUNTED;
+		}
+	}
+	h->attrs = sbuf;
+	h->attr_time = time(&curtime);
+	h->flags |= FHC_PREFETCHED;
+	Dprintf(D_FHCACHE, "fh_prefetch_entry: %s psi %08x\n",
+		pathbuf, key.psi);
+}
+
+/*
+ * Add the data of a WRITE to the handle's write-behind buffer. Returns
+ * 1 if the data has been buffered, and 0 if the caller has to write it
+ * itself. If writing out earlier data fails, that is remembered for
+ * the next COMMIT; it has nothing to do with this WRITE.
+ */
+int
+fh_wb_write(fhcache *fhc, int fd, char *data, size_t len, off_t offset)
+{
+	fhwb	*wb = fhc->wb;
+
+	if (wb != NULL && (offset != wb->offset + wb->len
+			|| wb->len + len > WB_BUFSIZE)) {
+		fh_wb_flush(fhc);
+		wb = NULL;
+	}
+	if (len > WB_BUFSIZE)
+		return 0;
+
+	if (wb == NULL) {
+		/* Make room by writing out the oldest buffers */
+		while (wb_head != NULL && wb_total + WB_BUFSIZE > fh_wb_max)
+			fh_wb_flush(wb_head->fhc);
+		if (wb_total + WB_BUFSIZE > fh_wb_max)
+			return 0;
+
+		wb = (fhwb *) xmalloc(sizeof(*wb));
+		if ((wb->fd = dup(fd)) < 0) {
+			free(wb);
+			return 0;
+		}
+		wb->data = (char *) xmalloc(WB_BUFSIZE);
+		wb->fhc = fhc;
+		wb->offset = offset;
+		wb->len = 0;
+		wb->since = time(&curtime);
+		wb->next = NULL;
+		if ((wb->prev = wb_tail) != NULL)
+			wb_tail->next = wb;
+		else
+			wb_head = wb;
+		wb_tail = wb;
+		wb_total += WB_BUFSIZE;
+		fhc->wb = wb;
+
+		/* Make sure the flusher runs in time */
+		if (wb_head == wb) {
+			unsigned int	left = alarm(0);
+
+			alarm((left && left < fh_wb_interval)?
+					left : fh_wb_interval);
+		}
+	}
+	memcpy(wb->data + wb->len, data, len);
+	wb->len += len;
+	wb->mtime = time(&curtime);
+	return 1;
+}
+
+/*
+ * Write out a handle's write-behind buffer. Since the WRITEs have long
+ * been acknowledged, all we can do about errors is complain, and keep
+ * the error for the next COMMIT of the file.
+ */
+int
+fh_wb_flush(fhcache *fhc)
+{
+	fhwb	*wb = fhc->wb;
+	size_t	done = 0;
+	int	n = 0, oerrno = 0;
+
+	if (wb == NULL)
+		return 0;
+
+	Dprintf(D_FHCACHE, "fh_wb_flush: %s, %lu bytes at %lu\n",
+		fhc->path ? fhc->path : "<unnamed>",
+		(unsigned long) wb->len, (unsigned long) wb->offset);
+	while (done < wb->len) {
+		n = efs_pwrite(wb->fd, wb->data + done, wb->len - done,
+						wb->offset + done);
+		if (n <= 0)
+			break;
+		done += n;
+	}
+	if (done < wb->len) {
+		oerrno = n < 0 ? errno : ENOSPC;
+		Dprintf(L_ERROR, "write-behind to %s failed: %s\n",
+			fhc->path ? fhc->path : "<unnamed>",
+			strerror(oerrno));
+		fhc->wb_error = oerrno;
+	}
+
+	if (wb->prev != NULL)
+		wb->prev->next = wb->next;
+	else
+		wb_head = wb->next;
+	if (wb->next != NULL)
+		wb->next->prev = wb->prev;
+	else
+		wb_tail = wb->prev;
+	wb_total -= WB_BUFSIZE;
+	fhc->wb = NULL;
+
+	/* The file has changed under the attributes we have cached */
+	fhc->flags &= ~(FHC_ATTRVALID|FHC_PREFETCHED);
+	efs_close(wb->fd);
+	free(wb->data);
+	free(wb);
+
+	if (oerrno) {
+		errno = oerrno;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Write out buffered data for PATH, if there is any.
+ */
+void
+fh_wb_flush_path(char *path)
+{
+	fhcache	*h;
+
+	if (wb_head != NULL && (h = fh_lookup_path(path)) != NULL)
+		fh_wb_flush(h);
+}
+
+/*
+ * Write out buffers older than fh_wb_interval seconds, or all of them.
+ */
+void
+fh_wb_sync(int force)
+{
+	time(&curtime);
+	while (wb_head != NULL
+	    && (force || curtime >= wb_head->since + fh_wb_interval))
+		fh_wb_flush(wb_head->fhc);
+}
+
+/*
+ * Tell the kernel about sequential READs and WRITEs on an fd, so it
+ * reads ahead of the client and doesn't let large copies push everyone
+ * else's data out of the page cache.
+ */
+void
+fh_io_hint(fhcache *fhc, int fd, off_t offset, size_t len, int write)
+{
+#ifdef POSIX_FADV_WILLNEED
+	fhfd	*fp;
+	off_t	end = offset + len, start;
+
+	for (fp = fhc->fds; fp != NULL && fp->fd != fd; fp = fp->next)
+		;
+	if (fp == NULL)
+		return;
+
+	if (offset + SEQ_SLACK >= fp->seq_next
+	 && offset <= fp->seq_next + SEQ_SLACK) {
+		if (fp->seq_count < SEQ_MIN
+		 && ++(fp->seq_count) == SEQ_MIN && !write)
+			posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		if (end > fp->seq_next)
+			fp->seq_next = end;
+	} else {
+		if (fp->seq_count >= SEQ_MIN && !write)
+			posix_fadvise(fd, 0, 0, POSIX_FADV_NORMAL);
+		fp->seq_count = 0;
+		fp->seq_start = fp->drop_end = offset;
+		fp->seq_next = end;
+		fp->ra_end = 0;
+		return;
+	}
+	if (fp->seq_count < SEQ_MIN)
+		return;
+
+	/* Keep the readahead window at least half full */
+	if (!write && end + SEQ_RA_WINDOW / 2 > fp->ra_end) {
+		start = MAX(fp->ra_end, end);
+		posix_fadvise(fd, start, SEQ_RA_WINDOW, POSIX_FADV_WILLNEED);
+		fp->ra_end = start + SEQ_RA_WINDOW;
+		Dprintf(D_FHCACHE, "fh_io_hint: %s readahead to %lu\n",
+			fhc->path, (unsigned long) fp->ra_end);
+	}
+
+	/* Drop what's behind a large one-pass stream, a megabyte at a
+	 * time. For WRITEs, this also starts writing out the pages. */
+	if (offset - fp->seq_start > SEQ_DROP_MIN
+	 && offset - SEQ_DROP_LAG >= fp->drop_end + SEQ_DROP_LAG) {
+		posix_fadvise(fd, fp->drop_end,
+			offset - SEQ_DROP_LAG - fp->drop_end,
+			POSIX_FADV_DONTNEED);
+		fp->drop_end = offset - SEQ_DROP_LAG;
+		Dprintf(D_FHCACHE, "fh_io_hint: %s dropped to %lu\n",
+			fhc->path, (unsigned long) fp->drop_end);
+	}
+#endif
+}
+
+#ifdef SEEK_DATA
+/*
+ * Find the data or hole extent of a file that contains offset. If the
+ * file system can't tell, the whole file is one data extent.
+ */
+static void
+fh_ext_find(fhcache *fhc, int fd, off_t offset)
+{
+	fhext	*ext = &fhc->ext;
+	off_t	size = fhc->attrs.st_size, pos;
+
+	ext->mtime = fhc->attrs.st_mtime;
+	ext->size = size;
+	ext->start = offset;
+	if ((pos = efs_lseek(fd, offset, SEEK_DATA)) < 0) {
+		/* ENXIO means there's no more data after offset */
+		if (errno == ENXIO) {
+			ext->end = size;
+			ext->hole = 1;
+		} else {
+			ext->start = 0;
+			ext->end = size;
+			ext->hole = 0;
+		}
+	} else if (pos > offset) {
+		ext->end = MIN(pos, size);
+		ext->hole = 1;
+	} else {
+		if ((pos = efs_lseek(fd, offset, SEEK_HOLE)) < 0)
+			pos = size;
+		ext->end = MIN(pos, size);
+		ext->hole = 0;
+	}
+	Dprintf(D_FHCACHE, "fh_ext_find: %s %s at %lu-%lu\n", fhc->path,
+		ext->hole ? "hole" : "data",
+		(unsigned long) ext->start, (unsigned long) ext->end);
+}
+#endif
+
+/*
+ * Read from a file like pread does, but fill holes with zeroes
+ * instead of having the file system hand out zero pages. To this end
+ * we remember the last extent we found in the file, which is usually
+ * all we need for sequential READs.
+ *
+ * The attributes auth_fh has just fetched tell us whether the extent
+ * is still good. An extent found in a file modified within the current
+ * second is used for this READ only, since a later change could leave
+ * the mtime as it is. Attributes prefetched by READDIR may be too old
+ * for this, and so is the size for telling where the file ends.
+ */
+int
+fh_read(fhcache *fhc, int fd, char *buf, size_t len, off_t offset)
+{
+#ifdef SEEK_DATA
+	fhext	*ext = &fhc->ext;
+	size_t	done = 0, n;
+	off_t	pos;
+	int	r;
+#endif
+
+	fh_io_hint(fhc, fd, offset, len, 0);
+#ifdef SEEK_DATA
+	if (!(fhc->flags & FHC_ATTRVALID) || (fhc->flags & FHC_ATTRCACHED)
+	 || !S_ISREG(fhc->attrs.st_mode) || offset >= fhc->attrs.st_size)
+		return efs_pread(fd, buf, len, offset);
+
+	if (ext->mtime != fhc->attrs.st_mtime
+	 || ext->size != fhc->attrs.st_size)
+		ext->start = ext->end = 0;
+
+	while (done < len) {
+		pos = offset + done;
+		if (pos >= fhc->attrs.st_size) {
+			/* The file may have grown since the lstat */
+			if ((r = efs_pread(fd, buf + done, len - done, pos)) > 0)
+				done += r;
+			else if (r < 0 && done == 0)
+				return -1;
+			break;
+		}
+		if (pos < ext->start || pos >= ext->end)
+			fh_ext_find(fhc, fd, pos);
+		if (pos >= ext->end)		/* file has shrunk */
+			break;
+		n = MIN(len - done, (size_t) (ext->end - pos));
+		if (ext->hole) {
+			memset(buf + done, 0, n);
+		} else {
+			if ((r = efs_pread(fd, buf + done, n, pos)) < 0) {
+				if (done == 0)
+					return -1;
+				break;
+			}
+			if (r == 0)
+				break;
+			n = r;
+		}
+		done += n;
+	}
+
+	time(&curtime);
+	if (fhc->attrs.st_mtime >= curtime)
+		ext->start = ext->end = 0;
+	return done;
+#else
+	return efs_pread(fd, buf, len, offset);
+#endif
+}
+
 /*
  * Close a file to make an fd available for a new file.
  */
@@ -1432,8 +2469,8 @@ fh_flush_fds(void)
 		Dprintf(D_FHCACHE, "fh_flush_fds: not flushing... io active\n");
 		return (-1);
 	}
-	while (fd_cache_size >= FD_CACHE_LIMIT)
-		fh_close(fd_lru_tail);
+	while (fd_cache_size >= fd_cache_limit)
+		fh_close_fd(fd_lru_tail);
 	return (0);
 }
 
@@ -1467,7 +2504,7 @@ fh_flush(int force)
 		int cache_size = 0;
 
 		ex_state = active;
-		time(&curtime);
+		fh_wb_sync(force);
 		/* Single execution thread */
 
 		/* works in empty case because: fh_tail.next = &fh_tail */
@@ -1479,9 +2516,13 @@ fh_flush(int force)
 				h = h->next;
 				fh_delete(h->prev);
 			} else {
-				if (h->fd >= 0 &&
-				    curtime > h->last_used + CLOSE_INTERVAL)
-					fh_close(h);
+				fhfd	*fp, *next;
+
+				for (fp = h->fds; fp != NULL; fp = next) {
+					next = fp->next;
+					if (curtime > fp->last_used + CLOSE_INTERVAL)
+						fh_close_fd(fp);
+				}
 				cache_size++;
 				h = h->next;
 			}
@@ -1495,6 +2536,43 @@ fh_flush(int force)
 	}
 }
 
+/*
+ * Re-read the exports file. Handles don't depend on the exports, so
+ * unlike in the old days we keep them, with their open files and
+ * cached attributes. What has to go is the client and mount point
+ * each handle remembers from auth_fh, since those are freed by
+ * auth_init. Handles of files that were exported before and aren't
+ * any longer are dropped, so their files get closed and the file
+ * system can be unmounted.
+ */
+void
+fh_reload_exports(void)
+{
+	fhcache	*h, *next;
+	int	dropped = 0;
+
+	for (h = fh_head.next; h != &fh_tail; h = h->next) {
+		if (h->path != NULL && auth_exported(h->path))
+			h->flags |= FHC_EXPORTED;
+		else
+			h->flags &= ~FHC_EXPORTED;
+	}
+
+	auth_init(NULL);	/* auth_init saves the exports file name */
+
+	for (h = fh_head.next; h != &fh_tail; h = next) {
+		next = h->next;
+		h->nauth = 0;
+		if ((h->flags & FHC_EXPORTED) && ex_state == inactive
+		 && !auth_exported(h->path)) {
+			fh_delete(h);
+			dropped++;
+		}
+	}
+	Dprintf(D_FHCACHE, "fh_reload_exports: kept %d handles, dropped %d\n",
+		fh_list_size, dropped);
+}
+
 RETSIGTYPE
 flush_cache(int sig)
 {
@@ -1512,7 +2590,52 @@ flush_cache(int sig)
 		rpc_closedown();
 	inprogress = 0;
 	need_flush = 0;
-	alarm(FLUSH_INTERVAL);
+	if (wb_head != NULL && fh_wb_interval < FLUSH_INTERVAL)
+		alarm(fh_wb_interval);
+	else
+		alarm(FLUSH_INTERVAL);
+}
+
+/*
+ * Raise our limit on open files as far as we're allowed to (but no
+ * further than FD_OPEN_MAX), and size the fd cache accordingly.
+ * If that takes us past FD_SETSIZE, cached files go above it, and
+ * everything below is left to sockets and the odd directory.
+ */
+static void
+fh_init_fdcache(void)
+{
+	int		nofile = FOPEN_MAX;
+#ifdef RLIMIT_NOFILE
+	struct rlimit	rl;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) >= 0) {
+		if (rl.rlim_max == RLIM_INFINITY || rl.rlim_max > FD_OPEN_MAX)
+			rl.rlim_max = FD_OPEN_MAX;
+		if (rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur < rl.rlim_max) {
+			rl.rlim_cur = rl.rlim_max;
+			if (setrlimit(RLIMIT_NOFILE, &rl) < 0)
+				Dprintf(L_WARNING,
+					"unable to raise RLIMIT_NOFILE: %s\n",
+					strerror(errno));
+		}
+		if (getrlimit(RLIMIT_NOFILE, &rl) >= 0
+		 && rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur > FOPEN_MAX)
+			nofile = rl.rlim_cur > FD_OPEN_MAX ?
+					FD_OPEN_MAX : rl.rlim_cur;
+	}
+#endif
+	if (nofile - FD_SETSIZE > FD_CACHE_LIMIT(FD_SETSIZE)) {
+		fd_cache_lowest = FD_SETSIZE;
+		fd_cache_limit = nofile - FD_SETSIZE;
+	} else {
+		if (nofile > FD_SETSIZE)
+			nofile = FD_SETSIZE;
+		fd_cache_limit = FD_CACHE_LIMIT(nofile);
+	}
+	fh_grow_fdcache(nofile - 1);
+	Dprintf(D_FHCACHE, "fd cache holds up to %d files\n",
+				fd_cache_limit);
 }
 
 void
@@ -1528,6 +2651,8 @@ fh_init(void)
 	fh_head.prev = fh_tail.prev = &fh_head;
 	/* last_flushable = &fh_tail; */
 
+	fh_init_fdcache();
+
 	install_signal_handler(SIGALRM, flush_cache);
 	alarm(FLUSH_INTERVAL);
 
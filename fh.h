@@ -20,6 +20,9 @@
 #define	FHC_XONLY_PATH		001	/* NOT USED ANYMORE */
 #define	FHC_ATTRVALID		002
 #define FHC_NFSMOUNTED		004
+#define FHC_PREFETCHED		010	/* attrs filled in by READDIR */
+#define FHC_EXPORTED		020	/* used by fh_reload_exports */
+#define FHC_ATTRCACHED		040	/* attrs not stat'ed for this request */
 
 /* Modes for fh_find */
 #define FHFIND_FEXISTS	0	/* file must exist */
@@ -34,9 +37,33 @@
 
 /*
  * This defines the maximum number of files nfsd may keep open for NFS I/O.
- * It used to be 8...
+ * It used to be 8, then 3*FOPEN_MAX/4. Now we raise RLIMIT_NOFILE to
+ * at most FD_OPEN_MAX at startup. The descriptors above FD_SETSIZE are
+ * used for the fd cache; if we don't get that many, 3/4 of them.
  */
-#define FD_CACHE_LIMIT		(3*FOPEN_MAX/4)
+#define FD_OPEN_MAX		65536
+#define FD_CACHE_LIMIT(nofile)	(3*(nofile)/4)
+
+/*
+ * A file may be open several times, for different users or access
+ * modes. This is the most descriptors we keep open for any one handle.
+ */
+#define FH_FD_LIMIT		4
+
+/*
+ * Access decisions made by path_open are remembered per handle, user
+ * and open mode, for up to FH_PERM_LIMIT combinations per handle. They
+ * are valid as long as the file's owner, group and mode don't change.
+ * The ctime is not part of the key, since every WRITE changes it. An
+ * ACL change shows only in the ctime, but a direct open is checked by
+ * the kernel anyway, and an override only depends on owner and mode.
+ * Negative decisions expire after PERM_DENY_TTL seconds, because they
+ * may have been caused by a parent directory or an ACL. So do those
+ * about searching a directory (FH_PERM_SEARCH), which guard the shared
+ * name cache and READDIR prefetch.
+ */
+#define FH_PERM_LIMIT		4
+#define PERM_DENY_TTL		5			/* 5 seconds	*/
 
 /* The following affect cache expiry.
  * CLOSE_INTERVAL applies to the closing of inactive file descriptors
@@ -54,6 +81,55 @@
 #define CLOSE_INTERVAL		5			/* 5 seconds	*/
 #define DISCARD_INTERVAL	(60*60)			/* 1 hour	*/
 
+/*
+ * READDIR prefetching. Attributes fetched on behalf of a READDIR are
+ * trusted for PREFETCH_TTL seconds by the LOOKUP that usually follows.
+ * We never prefetch more than PREFETCH_MAX entries per READDIR call,
+ * nor when the handle cache is already nearly full.
+ */
+#define PREFETCH_TTL		2			/* 2 seconds	*/
+#define PREFETCH_MAX		256
+
+/*
+ * Per-directory name cache. Each directory handle remembers up to
+ * DCACHE_MAX name -> psi mappings (psi 0 meaning "does not exist"),
+ * which are thrown away as soon as the directory's mtime changes.
+ */
+#define DCACHE_MAX		32
+
+/*
+ * Write-behind for exports with the async option. Contiguous WRITEs to
+ * a file are collected in a buffer of WB_BUFSIZE bytes and written out
+ * in one go when the buffer is full, after fh_wb_interval seconds, or
+ * when the file is read, stat'ed or changed in another way. All buffers
+ * together use no more than fh_wb_max bytes.
+ */
+#define WB_BUFSIZE		(64 * 1024)
+#define WB_DEFAULT_MAX		(1024 * 1024)
+#define WB_DEFAULT_INTERVAL	1			/* 1 second	*/
+
+/*
+ * Sequential access. A READ or WRITE starting within SEQ_SLACK bytes of
+ * where the previous one on the same fd ended continues a stream (UDP
+ * clients send their requests slightly out of order). After SEQ_MIN of
+ * those, we have the kernel read up to SEQ_RA_WINDOW bytes ahead of the
+ * client. Once a stream has covered more than SEQ_DROP_MIN bytes,
+ * it is taken to be a one-pass copy, and everything more than
+ * SEQ_DROP_LAG bytes behind it is dropped from the page cache.
+ */
+#define SEQ_SLACK		(128 * 1024)
+#define SEQ_MIN			2
+#define SEQ_RA_WINDOW		(512 * 1024)
+#define SEQ_DROP_MIN		((off_t) 64 * 1024 * 1024)
+#define SEQ_DROP_LAG		(1024 * 1024)
+
+/*
+ * auth_fh remembers the mount point found for the last FH_AUTH_LIMIT
+ * clients that used a handle, so that handles shared by several
+ * clients don't send each of them through auth_path again.
+ */
+#define FH_AUTH_LIMIT		4
+
 /*
  * Type of a pseudo inode
  */
@@ -91,27 +167,114 @@ typedef enum { inactive, active } mutex;
  *		name != ..
  *		index(name, '/') == 0
  */
+typedef struct fh_dentry {
+	struct fh_dentry *	next;
+	psi_t			psi;		/* 0 if negative */
+	char			name[1];
+} fh_dentry;
+
+/*
+ * An open file descriptor cached for a handle. Each handle keeps its
+ * descriptors on a list, most recently used first; all descriptors
+ * are also on a global LRU list.
+ */
+typedef struct fhfd {
+	struct fhfd *		next;
+	struct fhfd *		lru_next;
+	struct fhfd *		lru_prev;
+	struct fhcache *	fhc;
+	int			fd;
+	int			omode;
+	uid_t			uid;
+	time_t			last_used;
+	off_t			seq_start;	/* where the stream began */
+	off_t			seq_next;	/* where the stream goes on */
+	int			seq_count;	/* # of sequential requests */
+	off_t			ra_end;		/* end of readahead so far */
+	off_t			drop_end;	/* end of dropped pages */
+} fhfd;
+
+typedef struct fhperm {
+	struct fhperm *		next;
+	uid_t			uid;
+	gid_t			gid;
+	int			ngids;
+	GETGROUPS_T		gids[NGRPS];
+	int			omode;
+	int			access;		/* PERM_* below */
+	uid_t			f_uid;		/* file attrs when decided */
+	gid_t			f_gid;
+	mode_t			f_mode;
+	time_t			when;
+} fhperm;
+
+typedef struct fhwb {
+	struct fhwb *		next;		/* oldest first */
+	struct fhwb *		prev;
+	struct fhcache *	fhc;
+	int			fd;		/* private dup */
+	off_t			offset;
+	size_t			len;
+	time_t			since;
+	time_t			mtime;
+	char *			data;
+} fhwb;
+
+typedef struct fhauth {
+	nfs_client *		clnt;
+	nfs_mount *		mount;
+} fhauth;
+
+/*
+ * The last data or hole extent READ found in a file. It is only good
+ * as long as the file's mtime and size are those it was found with.
+ */
+typedef struct fhext {
+	off_t			start;
+	off_t			end;		/* start == end: none */
+	int			hole;
+	time_t			mtime;
+	off_t			size;
+} fhext;
+
+#define PERM_DIRECT		1	/* plain open succeeds */
+#define PERM_OVERRIDE		2	/* open with root fsuid */
+#define PERM_DENIED		3	/* EACCES */
+
+/* fhperm omode for search permission on a directory */
+#define FH_PERM_SEARCH		(-1)
+
 typedef struct fhcache {
 	struct fhcache *	next;
 	struct fhcache *	prev;
 	struct fhcache *	hash_next;
-	struct fhcache *	fd_next;
-	struct fhcache *	fd_prev;
+	struct fhcache *	path_next;
 	svc_fh			h;
-	int			fd;
-	int			omode;
+	fhfd *			fds;
+	int			nfds;
+	fhperm *		perms;
+	int			nperms;
+	fhwb *			wb;
+	int			wb_error;	/* for the next COMMIT */
+	fhext			ext;
 	char *			path;
 	time_t			last_used;
-	nfs_client *		last_clnt;
-	nfs_mount *		last_mount;
-	uid_t			last_uid;
+	time_t			attr_time;
+	fhauth			auth[FH_AUTH_LIMIT];	/* most recent first */
+	int			nauth;
 	int			flags;
 	struct stat		attrs;
+	fh_dentry *		dcache;
+	time_t			dcache_mtime;
+	int			dcache_size;
 } fhcache;
 
 /* Global FH variables. */
 extern int			_rpcpmstart;
 extern int			fh_initialized;
+extern int			fh_prefetch;
+extern int			fh_wb_max;
+extern int			fh_wb_interval;
 
 /* Global function prototypes. */
 extern nfsstat	nfs_errno(void);
@@ -124,16 +287,37 @@ extern char	*fh_path(nfs_fh *fh, nfsstat *status);
 extern int	path_open(char *path, int omode, int perm);
 extern int	fh_fd(fhcache *fhc, nfsstat *status, int omode);
 extern void	fd_inactive(int fd);
+extern void	fh_perm_flush(fhcache *fhc);
+extern int	fh_wb_write(fhcache *fhc, int fd, char *data, size_t len,
+				off_t offset);
+extern int	fh_wb_flush(fhcache *fhc);
+extern void	fh_wb_flush_path(char *path);
+extern void	fh_wb_sync(int force);
+extern int	fh_read(fhcache *fhc, int fd, char *buf, size_t len,
+				off_t offset);
+extern void	fh_io_hint(fhcache *fhc, int fd, off_t offset, size_t len,
+				int write);
 extern nfsstat	fh_compose(diropargs *dopa, nfs_fh *new_fh,
 				struct stat *sbp, int fd,
 				int omode, int public);
 extern psi_t	fh_psi(nfs_fh *fh);
 extern void	fh_remove(char *path);
+extern void	fh_rename(char *from, char *to);
+extern void	fh_dir_modified(char *path);
+extern void	fh_prefetch_entry(fhcache *dirh, int dirfd, char *name,
+				ino_t ino, dev_t dev);
 extern nfs_fh	*fh_handle(fhcache *fhc);
 extern void	fh_flush(int force);
+extern void	fh_reload_exports(void);
 extern RETSIGTYPE flush_cache(int sig);
 extern int	nfsmounted(const char *path, struct stat *sbp);
 
+/* mounttab.c */
+#define MNT_UNKNOWN		(-1)
+extern int	mnt_covered(const char *path, struct stat *sbp);
+extern void	mnt_set_covered(const char *path, struct stat *sbp,
+					dev_t covered_dev, ino_t covered_ino);
+
 #ifdef ENABLE_DEVTAB
 extern unsigned int	devtab_index(dev_t);
 #endif
@@ -122,6 +122,14 @@ struct svc_req	*rqstp;
 	attr->ctime.seconds = s->st_ctime;
 	attr->ctime.useconds = 0;
 
+	/* Account for data still sitting in the write-behind buffer */
+	if (fhc->wb != NULL) {
+		if (attr->size < fhc->wb->offset + fhc->wb->len)
+			attr->size = fhc->wb->offset + fhc->wb->len;
+		attr->mtime.seconds = fhc->wb->mtime;
+		attr->ctime.seconds = fhc->wb->mtime;
+	}
+
 #ifdef DEBUG
 	sp = buff;
 	sprintf(sp, " t=%d, m=%o, lk=%d, u/g=%d/%d, sz=%d, bsz=%d",
@@ -144,3 +152,73 @@ struct svc_req	*rqstp;
 
 	return (NFS_OK);
 }
+
+/*
+ * NFS version 3 has no NFNON or NFBAD, and numbers the FIFO differently.
+ */
+#define ftype3_map(st_mode) (_ftype3_map[((st_mode) & S_IFMT) >> 12])
+
+static ftype3 _ftype3_map[16] =
+{
+	NF3REG, NF3FIFO, NF3CHR, NF3REG,
+	NF3DIR, NF3REG, NF3BLK, NF3REG,
+	NF3REG, NF3REG, NF3LNK, NF3REG,
+	NF3SOCK, NF3REG, NF3REG, NF3REG,
+};
+
+/*
+ * Get NFSv3 file attributes given the cache entry. This works just
+ * like fhc_getattr, but sizes are 64 bits wide.
+ */
+nfsstat
+fhc_getattr3(fhcache *fhc, fattr3 *attr, struct stat *stat_optimize,
+				struct svc_req *rqstp)
+{
+	struct stat *s;
+	struct stat sbuf;
+
+	if (stat_optimize != NULL
+	 && stat_optimize->st_nlink != 0)
+		s = stat_optimize;
+	else if (efs_lstat(fhc->path, (s = &sbuf)) != 0) {
+		Dprintf(D_CALL, "getattr3(%s): failed!  errno=%d\n", 
+			fhc->path, errno);
+		return nfs_errno();
+	}
+	attr->type = ftype3_map(s->st_mode);
+	attr->mode = s->st_mode & 07777;
+	attr->nlink = s->st_nlink;
+	attr->uid = ruid(s->st_uid, nfsmount, rqstp);
+	attr->gid = rgid(s->st_gid, nfsmount, rqstp);
+	attr->size = s->st_size;
+#ifdef HAVE_ST_BLOCKS
+	attr->used = (size3) s->st_blocks * 512;
+#else
+	attr->used = (size3) st_blocks(s) * 512;
+#endif
+#if defined(major) && defined(minor)
+	attr->rdev.specdata1 = major(s->st_rdev);
+	attr->rdev.specdata2 = minor(s->st_rdev);
+#else
+	attr->rdev.specdata1 = (s->st_rdev >> 8) & 0xff;
+	attr->rdev.specdata2 = s->st_rdev & 0xff;
+#endif
+	attr->fsid   = 1;
+	attr->fileid = fh_psi((nfs_fh *)&(fhc->h));
+	attr->atime.seconds = s->st_atime;
+	attr->atime.nseconds = 0;
+	attr->mtime.seconds = s->st_mtime;
+	attr->mtime.nseconds = 0;
+	attr->ctime.seconds = s->st_ctime;
+	attr->ctime.nseconds = 0;
+
+	/* Account for data still sitting in the write-behind buffer */
+	if (fhc->wb != NULL) {
+		if (attr->size < fhc->wb->offset + fhc->wb->len)
+			attr->size = fhc->wb->offset + fhc->wb->len;
+		attr->mtime.seconds = fhc->wb->mtime;
+		attr->ctime.seconds = fhc->wb->mtime;
+	}
+
+	return (NFS_OK);
+}
@@ -20,21 +20,56 @@
 /* This is from libwrap.a */
 extern int		hosts_ctl(char *, char *, char *, char *);
 
-#define IP_HASH_MASK	0xF
-#define IP_HASH(a)	((((a)>>24)^((a)>>16)^((a)>>8)^(a))&IP_HASH_MASK)
+#ifndef HOSTS_ALLOW
+#define HOSTS_ALLOW		"/etc/hosts.allow"
+#endif
+#ifndef HOSTS_DENY
+#define HOSTS_DENY		"/etc/hosts.deny"
+#endif
+
+/*
+ * Access decisions are kept in a hash table, and on an LRU list so that
+ * the least recently seen host makes room when the cache is full. Each
+ * decision is good for HACS_TIMEOUT seconds. All of them are dropped
+ * when hosts.allow or hosts.deny changes, which we look for every
+ * HACS_CHECK seconds.
+ */
+#define HACS_HASHBITS		10
+#define HACS_HASHSIZE		(1 << HACS_HASHBITS)
+#define IP_HASH(a)		(((unsigned int) (a) * 2654435761U) \
+					>> (32 - HACS_HASHBITS))
 
 typedef struct clnt_host {
-	struct clnt_host	*next;
+	struct clnt_host	*next;		/* hash chain */
+	struct clnt_host	*lru_prev;
+	struct clnt_host	*lru_next;
 	struct in_addr		clnt_addr;
+	time_t			expires;
 	char			status;
 } clnt_host;
 
-#define HACS_MAXHOSTS		256
-#define HACS_INTERVAL		3600		/* one hour */
+#define HACS_MAXHOSTS		4096
+#define HACS_TIMEOUT		3600		/* one hour */
+#define HACS_CHECK		30		/* look at the files */
 
-static clnt_host		*clients[IP_HASH_MASK+1];
+static clnt_host		*clients[HACS_HASHSIZE];
+static clnt_host		*lru_head = NULL;	/* most recent */
+static clnt_host		*lru_tail = NULL;
 static unsigned int		nrhosts = 0;
-static time_t			lastflush = 0;
+
+typedef struct hacs_file {
+	const char		*name;
+	int			exists;
+	dev_t			dev;
+	ino_t			ino;
+	off_t			size;
+	time_t			mtime;
+} hacs_file;
+
+static hacs_file		acsfiles[2] = {
+	{ HOSTS_ALLOW }, { HOSTS_DENY },
+};
+static time_t			lastcheck = 0;
 
 
 /*
@@ -47,6 +82,79 @@ int	allow_severity = LOG_INFO;
 #endif
 
 
+static void
+lru_unlink(clnt_host *hp)
+{
+	if (hp->lru_prev)
+		hp->lru_prev->lru_next = hp->lru_next;
+	else
+		lru_head = hp->lru_next;
+	if (hp->lru_next)
+		hp->lru_next->lru_prev = hp->lru_prev;
+	else
+		lru_tail = hp->lru_prev;
+}
+
+static void
+lru_insert(clnt_host *hp)
+{
+	hp->lru_prev = NULL;
+	hp->lru_next = lru_head;
+	if (lru_head)
+		lru_head->lru_prev = hp;
+	else
+		lru_tail = hp;
+	lru_head = hp;
+}
+
+/*
+ * Throw out the host that hasn't been seen for the longest time.
+ */
+static void
+evict_host(void)
+{
+	clnt_host	*hp, **hpp;
+
+	if ((hp = lru_tail) == NULL)
+		return;
+	lru_unlink(hp);
+	hpp = &clients[IP_HASH(hp->clnt_addr.s_addr)];
+	while (*hpp != hp)
+		hpp = &(*hpp)->next;
+	*hpp = hp->next;
+	free(hp);
+	nrhosts--;
+}
+
+/*
+ * See if hosts.allow or hosts.deny have changed since we last looked.
+ */
+static int
+files_changed(void)
+{
+	struct stat	stb;
+	hacs_file	*fp;
+	int		i, exists, changed = 0;
+
+	for (i = 0; i < 2; i++) {
+		fp = &acsfiles[i];
+		exists = (stat(fp->name, &stb) >= 0);
+		if (!exists)
+			memset(&stb, 0, sizeof(stb));
+		if (exists != fp->exists
+		 || stb.st_dev != fp->dev || stb.st_ino != fp->ino
+		 || stb.st_size != fp->size || stb.st_mtime != fp->mtime) {
+			fp->exists = exists;
+			fp->dev = stb.st_dev;
+			fp->ino = stb.st_ino;
+			fp->size = stb.st_size;
+			fp->mtime = stb.st_mtime;
+			changed = 1;
+		}
+	}
+	return changed;
+}
+
 int
 client_checkaccess(char *rpcprog, struct sockaddr_in *sin, int checkport)
 {
@@ -62,9 +170,16 @@ client_checkaccess(char *rpcprog, struct sockaddr_in *sin, int checkport)
 		return 0;
 	}
 
-	/* Flush once per hour */
-	if ((now = time(NULL)) - lastflush > HACS_INTERVAL)
-		client_flushaccess();
+	now = time(NULL);
+	if (now - lastcheck >= HACS_CHECK) {
+		/* The first look only records what the files are like */
+		if (files_changed() && lastcheck != 0) {
+			Dprintf(D_AUTH, "%s or %s changed\n",
+					HOSTS_ALLOW, HOSTS_DENY);
+			client_flushaccess();
+		}
+		lastcheck = now;
+	}
 
 	hash = IP_HASH(addr.s_addr);
 	for (hp = clients[hash]; hp != NULL; hp = hp->next) 
@@ -72,16 +187,23 @@ client_checkaccess(char *rpcprog, struct sockaddr_in *sin, int checkport)
 
 	if (hp == NULL) {
 		if (nrhosts >= HACS_MAXHOSTS)
-			client_flushaccess();
+			evict_host();
 
 		hp = (clnt_host *) xmalloc(sizeof(*hp));
 		hp->next = clients[hash];
 		clients[hash] = hp;
-
 		hp->clnt_addr = addr;
+		hp->expires = 0;
+		nrhosts++;
+	} else {
+		lru_unlink(hp);
+	}
+	lru_insert(hp);
+
+	if (hp->expires <= now) {
 		hp->status = hosts_ctl(rpcprog, "unknown",
 					inet_ntoa(addr), "root");
-		nrhosts++;
+		hp->expires = now + HACS_TIMEOUT;
 	}
 
 	if (!hp->status)
@@ -94,23 +216,15 @@ client_checkaccess(char *rpcprog, struct sockaddr_in *sin, int checkport)
 void
 client_flushaccess(void)
 {
-	static int	flushing = 0;
 	clnt_host	*hp;
-	int		i;
-
-	if (flushing)
-		return;
-	flushing = 1;
 
 	Dprintf(D_AUTH, "flushed host access cache\n");
-	for (i = 0; i < IP_HASH_MASK+1; i++) {
-		while ((hp = clients[i]) != NULL) {
-			clients[i] = hp->next;
-			free (hp);
-		}
+	while ((hp = lru_head) != NULL) {
+		lru_head = hp->lru_next;
+		free (hp);
 	}
+	memset(clients, 0, sizeof(clients));
+	lru_tail = NULL;
 	nrhosts = 0;
-	flushing = 0;
-	lastflush = time(NULL);
 }
 #endif /* HOSTS_ACCESS */
@@ -0,0 +1,102 @@
+/*
+ * iobuf.c	Buffers for READ data.
+ *
+ *		READ replies point into a buffer that has to stay around
+ *		until the dispatcher has sent them. Rather than keeping
+ *		one static buffer as large as the largest transfer, we
+ *		hand out buffers from a few size classes, from 4K up to
+ *		NFS_MAXXFER. Small READs thus keep using a small buffer,
+ *		and the large ones are only allocated once clients start
+ *		doing large transfers.
+ *
+ *		All buffers given out while handling a request are taken
+ *		back by iobuf_release() after the reply has been sent.
+ *		Free buffers of a class that hasn't been used for a while
+ *		are returned to the system.
+ */
+
+#include "nfsd.h"
+
+#define IOBUF_SHIFT	12			/* smallest class is 4K	*/
+#define IOBUF_CLASSES	5			/* 4K ... 64K		*/
+#define IOBUF_KEEP	2			/* free bufs per class	*/
+#define IOBUF_BUSY	4			/* bufs per request	*/
+#define IOBUF_IDLE	60			/* secs before trimming	*/
+
+typedef struct iobuf_class {
+	char *		free[IOBUF_KEEP];
+	int		nfree;
+	time_t		last_used;
+} iobuf_class;
+
+static iobuf_class	classes[IOBUF_CLASSES];
+static char *		busy[IOBUF_BUSY];
+static int		busy_class[IOBUF_BUSY];
+static int		nbusy = 0;
+static time_t		last_trim = 0;
+
+/*
+ * Get a buffer of at least size bytes, which must not exceed
+ * NFS_MAXXFER. Returns NULL if the request already holds too many.
+ */
+char *
+iobuf_get(size_t size)
+{
+	iobuf_class	*cp;
+	char		*buf;
+	int		c;
+
+	for (c = 0; c < IOBUF_CLASSES - 1; c++)
+		if (size <= ((size_t) 1 << (IOBUF_SHIFT + c)))
+			break;
+	if (nbusy >= IOBUF_BUSY)
+		return NULL;
+
+	cp = &classes[c];
+	if (cp->nfree)
+		buf = cp->free[--(cp->nfree)];
+	else
+		buf = (char *) xmalloc((size_t) 1 << (IOBUF_SHIFT + c));
+	cp->last_used = nfs_dispatch_time;
+
+	busy[nbusy] = buf;
+	busy_class[nbusy++] = c;
+	return buf;
+}
+
+/*
+ * Free the buffers of classes that haven't been used recently.
+ */
+static void
+iobuf_trim(void)
+{
+	iobuf_class	*cp;
+
+	for (cp = classes; cp < classes + IOBUF_CLASSES; cp++) {
+		if (cp->last_used + IOBUF_IDLE > nfs_dispatch_time)
+			continue;
+		while (cp->nfree)
+			free(cp->free[--(cp->nfree)]);
+	}
+	last_trim = nfs_dispatch_time;
+}
+
+/*
+ * Take back all buffers handed out for the current request.
+ */
+void
+iobuf_release(void)
+{
+	iobuf_class	*cp;
+
+	while (nbusy) {
+		nbusy--;
+		cp = &classes[busy_class[nbusy]];
+		if (cp->nfree < IOBUF_KEEP)
+			cp->free[cp->nfree++] = busy[nbusy];
+		else
+			free(busy[nbusy]);
+	}
+	if (last_trim + IOBUF_IDLE <= nfs_dispatch_time)
+		iobuf_trim();
+}
@@ -55,6 +55,10 @@ const FHSIZE = 32;		/* size in bytes of a file handle */
  */
 typedef opaque fhandle[FHSIZE];	
 
+const FHSIZE3 = 64;		/* max size in bytes of a v3 file handle */
+
+typedef opaque fhandle3<FHSIZE3>;
+
 /*
  * If a status of zero is returned, the call completed successfully, and 
  * a file handle for the directory follows. A non-zero status indicates
@@ -70,6 +74,35 @@ default:
 /*
  * The type dirpath is the pathname of a directory
  */
+/*
+ * Status codes of version three of the mount protocol. They share
+ * their values with the NFS version 3 status codes.
+ */
+enum mountstat3 {
+	MNT3_OK = 0,			/* no error */
+	MNT3ERR_PERM = 1,		/* not owner */
+	MNT3ERR_NOENT = 2,		/* no such file or directory */
+	MNT3ERR_IO = 5,			/* I/O error */
+	MNT3ERR_ACCES = 13,		/* permission denied */
+	MNT3ERR_NOTDIR = 20,		/* not a directory */
+	MNT3ERR_INVAL = 22,		/* invalid argument */
+	MNT3ERR_NAMETOOLONG = 63,	/* filename too long */
+	MNT3ERR_NOTSUPP = 10004,	/* operation not supported */
+	MNT3ERR_SERVERFAULT = 10006	/* a failure on the server */
+};
+
+struct mountres3_ok {
+	fhandle3	fhandle;
+	int		auth_flavors<>;
+};
+
+union mountres3 switch (mountstat3 fhs_status) {
+case MNT3_OK:
+	mountres3_ok	mountinfo;
+default:
+	void;
+};
+
 typedef string dirpath<MNTPATHLEN>;
 
 /*
@@ -248,6 +281,32 @@ program MOUNTPROG {
 		ppathcnf
 		MOUNTPROC_PATHCONF(dirpath) = 7;
 	} = 2;
+
+	/*
+	 * Version three of the mount protocol communicates with version
+	 * three of the NFS protocol. MNT returns a variable length file
+	 * handle along with the acceptable authentication flavors, and
+	 * EXPORTALL and PATHCONF are gone.
+	 */
+	version MOUNTVERS3 {
+		void
+		MOUNTPROC_NULL(void) = 0;
+
+		mountres3
+		MOUNTPROC_MNT(dirpath) = 1;
+
+		mountlist
+		MOUNTPROC_DUMP(void) = 2;
+
+		void
+		MOUNTPROC_UMNT(dirpath) = 3;
+
+		void
+		MOUNTPROC_UMNTALL(void) = 4;
+
+		exports
+		MOUNTPROC_EXPORT(void)  = 5;
+	} = 3;
 } = 100005;
 
 #ifdef RPC_HDR
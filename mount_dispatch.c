@@ -24,7 +24,7 @@ union result_types	result;
 /*
  * MOUNT versions supported by this implementation
  */
-#define	MAXVERS		2
+#define	MAXVERS		3
 
 /*
  * This is a dispatch table to simplify error checking,
@@ -90,14 +90,26 @@ static struct dispatch_entry mount_2_table[] = {
 	table_ent(2,ppathcnf,dirpath,pathconf),		/* PATHCONF */
 };
 
+/* Version 3 only differs in MNT, and has no EXPORTALL */
+static struct dispatch_entry mount_3_table[] = {
+	table_ent(1,nil,nil,null),			/* NULL */
+	table_ent(3,mountres3,dirpath,mnt),		/* MNT */
+	table_ent(1,mountlist,void,dump),		/* DUMP */
+	table_ent(1,void,dirpath,umnt),			/* UMNT */
+	table_ent(1,void,void,umntall),			/* UMNTALL */
+	table_ent(1,exports,void,export),		/* EXPORT */
+};
+
 static struct dispatch_entry * dtable[MAXVERS] = {
 	mount_1_table,
 	mount_2_table,
+	mount_3_table,
 };
 
 static unsigned int		dtnrprocs[MAXVERS] = {
 	sizeof(mount_1_table) / sizeof(mount_1_table[0]),
 	sizeof(mount_2_table) / sizeof(mount_2_table[0]),
+	sizeof(mount_3_table) / sizeof(mount_3_table[0]),
 };
 
 /*
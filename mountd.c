@@ -67,6 +67,7 @@ static const char *	shortopts = "Fd:f:hnpP:rtvz::";
 static int	mountd_versions[] = {
 	MOUNTVERS,
 	MOUNTVERS_POSIX,
+	MOUNTVERS3,
 	0
 };
 
@@ -168,6 +169,32 @@ mountproc_mnt_1_svc(dirpath *argp, struct svc_req *rqstp)
 	return (res);
 }
 
+/*
+ * MNT, version 3
+ * This is the same as version 1, except that the handle is returned as
+ * a counted opaque, together with the flavors we accept. NFSv3 uses the
+ * same 32 byte handles as NFSv2.
+ */
+mountres3 *
+mountproc_mnt_3_svc(dirpath *argp, struct svc_req *rqstp)
+{
+	static char	fhbuf[FHSIZE];
+	static int	flavors[] = { AUTH_UNIX };
+	mountres3	*res = (mountres3 *) &result;
+	fhstatus	*fhs;
+
+	fhs = mountproc_mnt_1_svc(argp, rqstp);
+	if ((res->fhs_status = fhs->fhs_status) == MNT3_OK) {
+		memcpy(fhbuf, fhs->fhstatus_u.fhs_fhandle, FHSIZE);
+		res->mountres3_u.mountinfo.fhandle.fhandle3_len = FHSIZE;
+		res->mountres3_u.mountinfo.fhandle.fhandle3_val = fhbuf;
+		res->mountres3_u.mountinfo.auth_flavors.auth_flavors_len = 1;
+		res->mountres3_u.mountinfo.auth_flavors.auth_flavors_val =
+								flavors;
+	}
+	return (res);
+}
+
 /*
  * DUMP
  * Dump the contents of rmtab on the caller.
@@ -477,8 +504,7 @@ reinitialize(int sig)
 	}
 	if (inprogress++)
 		return;
-	fh_flush(1);
-	auth_init(NULL);
+	fh_reload_exports();
 	inprogress = 0;
 	need_reinit = 0;
 
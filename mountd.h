@@ -30,6 +30,7 @@ union result_types {
 	mountlist		mountlist;
 	exports			exports;
 	ppathcnf		pathconf;
+	mountres3		mountres3;
 };
 
 /* Global variables. */
@@ -0,0 +1,411 @@
+/*
+ * mounttab.c	Cached copy of the kernel's mount table.
+ *
+ *		path_psi needs to know whether a directory is a mount point,
+ *		and if so, which inode of the parent file system it covers.
+ *		Finding out the hard way means an lstat of the parent, and
+ *		a readdir scan of the parent for mount points. Instead, we
+ *		keep the list of mount points from /proc/self/mountinfo,
+ *		along with the covered dev/ino of each (filled in lazily,
+ *		the first time path_psi scans the parent directory).
+ *
+ *		The table is reread whenever the kernel tells us the mount
+ *		table has changed; we check for this at most once a second,
+ *		or when we see a device number we don't know about.
+ *
+ *		If the mount table isn't available (non-Linux systems,
+ *		or /proc not mounted), all functions return MNT_UNKNOWN and
+ *		callers fall back to doing things the old way.
+ *
+ *		This module also provides nfsmounted(), which used to live
+ *		in nfsmounted.c:
+ *
+ *		nfsmounted.c -- determine if a pathname has been NFS mounted
+ *		Copyright (C) 1993 Rick Sladkey <jrs@world.std.com>
+ *
+ *		This program is free software; you can redistribute it
+ *		and/or modify it under the terms of the GNU Library Public
+ *		License as published by the Free Software Foundation;
+ *		either version 2, or (at your option) any later version.
+ */
+
+#include "nfsd.h"
+#ifdef __linux__
+#include <sys/poll.h>
+#endif
+
+#ifndef PATH_MOUNTINFO
+# define PATH_MOUNTINFO		"/proc/self/mountinfo"
+#endif
+#define MNT_HASH_SIZE		64
+
+typedef struct mnt_entry {
+	struct mnt_entry *	path_next;
+	struct mnt_entry *	dev_next;
+	int			id;
+	dev_t			dev;		/* as seen by stat() */
+	char *			path;
+	char *			fstype;
+	int			covered_valid;
+	int			root_known;	/* -1: can't tell */
+	dev_t			root_dev;
+	ino_t			root_ino;
+	dev_t			covered_dev;
+	ino_t			covered_ino;
+} mnt_entry;
+
+static mnt_entry *		mnt_pathhash[MNT_HASH_SIZE];
+static mnt_entry *		mnt_devhash[MNT_HASH_SIZE];
+static int			mnt_fd = -1;
+static int			mnt_available = -1;
+static time_t			mnt_lastcheck = 0;
+
+static int			mnt_refresh(int force);
+
+static inline unsigned int
+mnt_hash_path(const char *path)
+{
+	register unsigned int	h = 0;
+
+	while (*path)
+		h = h * 31 + (unsigned char) *path++;
+	return h % MNT_HASH_SIZE;
+}
+
+#define mnt_hash_dev(dev)	((unsigned int) (dev) % MNT_HASH_SIZE)
+
+static mnt_entry *
+mnt_find_path(const char *path)
+{
+	mnt_entry	*mp;
+
+	mp = mnt_pathhash[mnt_hash_path(path)];
+	while (mp != NULL && strcmp(mp->path, path) != 0)
+		mp = mp->path_next;
+	return mp;
+}
+
+static mnt_entry *
+mnt_find_dev(dev_t dev)
+{
+	mnt_entry	*mp;
+
+	mp = mnt_devhash[mnt_hash_dev(dev)];
+	while (mp != NULL && mp->dev != dev)
+		mp = mp->dev_next;
+	return mp;
+}
+
+static void
+mnt_hash_dev_entry(mnt_entry *mp)
+{
+	unsigned int	h = mnt_hash_dev(mp->dev);
+
+	mp->dev_next = mnt_devhash[h];
+	mnt_devhash[h] = mp;
+}
+
+static void
+mnt_unhash_dev_entry(mnt_entry *mp)
+{
+	mnt_entry	**mpp;
+
+	mpp = &mnt_devhash[mnt_hash_dev(mp->dev)];
+	while (*mpp != NULL && *mpp != mp)
+		mpp = &(*mpp)->dev_next;
+	if (*mpp != NULL)
+		*mpp = mp->dev_next;
+	mp->dev_next = NULL;
+}
+
+/*
+ * Undo the octal escapes the kernel uses for blanks etc.
+ */
+static void
+mnt_unescape(char *s)
+{
+	char	*d = s;
+
+	while (*s) {
+		if (s[0] == '\\' && s[1] >= '0' && s[1] <= '3'
+		 && s[2] >= '0' && s[2] <= '7' && s[3] >= '0' && s[3] <= '7') {
+			*d++ = ((s[1] - '0') << 6) | ((s[2] - '0') << 3)
+				| (s[3] - '0');
+			s += 4;
+		} else {
+			*d++ = *s++;
+		}
+	}
+	*d = '\0';
+}
+
+/*
+ * Read the mount table. Covered inode information is carried over
+ * from the old table for mounts that are still there.
+ */
+static int
+mnt_read(void)
+{
+	mnt_entry	*old[MNT_HASH_SIZE], *mp, *op, *next;
+	char		line[2 * PATH_MAX], *sp, *fields[6];
+	unsigned int	major_no, minor_no, h;
+	FILE		*fp;
+	int		i, nmounts = 0;
+
+	if ((fp = fopen(PATH_MOUNTINFO, "r")) == NULL) {
+		Dprintf(D_FHCACHE, "can't open %s: %s\n",
+				PATH_MOUNTINFO, strerror(errno));
+		return -1;
+	}
+
+	memcpy(old, mnt_pathhash, sizeof(old));
+	memset(mnt_pathhash, 0, sizeof(mnt_pathhash));
+	memset(mnt_devhash, 0, sizeof(mnt_devhash));
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		/* id parent major:minor root mountpoint opts ... - type ... */
+		i = 0;
+		for (sp = strtok(line, " \n"); sp; sp = strtok(NULL, " \n")) {
+			if (i < 5) {
+				fields[i++] = sp;
+			} else if (!strcmp(sp, "-")) {
+				if ((fields[5] = strtok(NULL, " \n")) != NULL)
+					i++;
+				break;
+			}
+		}
+		if (i < 6 || sscanf(fields[2], "%u:%u",
+					&major_no, &minor_no) != 2)
+			continue;
+
+		mnt_unescape(fields[4]);
+		mp = (mnt_entry *) xmalloc(sizeof(*mp));
+		memset(mp, 0, sizeof(*mp));
+		mp->id = atoi(fields[0]);
+		mp->dev = makedev(major_no, minor_no);
+		mp->path = xstrdup(fields[4]);
+		mp->fstype = xstrdup(fields[5]);
+
+		/* Later mounts hide earlier ones at the same place */
+		if ((op = mnt_find_path(mp->path)) != NULL)
+			op->path[0] = '\0';
+
+		/* Carry over what we know about the covered inode */
+		for (op = old[mnt_hash_path(mp->path)]; op; op = op->path_next) {
+			if (op->id == mp->id && !strcmp(op->path, mp->path)) {
+				mp->covered_valid = op->covered_valid;
+				mp->root_known = op->root_known;
+				mp->root_dev = op->root_dev;
+				mp->root_ino = op->root_ino;
+				mp->covered_dev = op->covered_dev;
+				mp->covered_ino = op->covered_ino;
+				mp->dev = op->dev;
+				break;
+			}
+		}
+
+		h = mnt_hash_path(mp->path);
+		mp->path_next = mnt_pathhash[h];
+		mnt_pathhash[h] = mp;
+		mnt_hash_dev_entry(mp);
+		nmounts++;
+	}
+	fclose(fp);
+
+	for (h = 0; h < MNT_HASH_SIZE; h++) {
+		for (op = old[h]; op != NULL; op = next) {
+			next = op->path_next;
+			free(op->path);
+			free(op->fstype);
+			free(op);
+		}
+	}
+
+	Dprintf(D_FHCACHE, "read %d entries from %s\n",
+				nmounts, PATH_MOUNTINFO);
+	return 0;
+}
+
+/*
+ * Check whether the mount table has changed, and reread it if so.
+ * Unless FORCE is set, we do this at most once a second.
+ */
+static int
+mnt_refresh(int force)
+{
+#ifdef __linux__
+	struct pollfd	pfd;
+	time_t		now;
+
+	if (mnt_available == 0)
+		return 0;
+
+	if (mnt_available < 0) {
+		if ((mnt_fd = open(PATH_MOUNTINFO, O_RDONLY)) < 0
+		 || mnt_read() < 0) {
+			if (mnt_fd >= 0)
+				close(mnt_fd);
+			mnt_fd = -1;
+			mnt_available = 0;
+			return 0;
+		}
+		mnt_available = 1;
+		time(&mnt_lastcheck);
+		return 0;
+	}
+
+	time(&now);
+	if (!force && now == mnt_lastcheck)
+		return 0;
+	mnt_lastcheck = now;
+
+	/* The kernel flags POLLPRI on this file when the mount table
+	 * changes, and clears it again when we poll. */
+	pfd.fd = mnt_fd;
+	pfd.events = POLLPRI;
+	pfd.revents = 0;
+	if (poll(&pfd, 1, 0) <= 0 || !(pfd.revents & (POLLPRI|POLLERR)))
+		return 0;
+
+	Dprintf(D_FHCACHE, "mount table changed\n");
+	return mnt_read() == 0;
+#else
+	mnt_available = 0;
+	return 0;
+#endif
+}
+
+/*
+ * Is this directory the root of any mount of its device? We learn
+ * the root inode of a mount the first time we need it. A mount we
+ * can't reach by its path (because something else has been mounted
+ * on top, say) can't be what the caller's path led to, either.
+ */
+static int
+mnt_is_root(struct stat *sbp)
+{
+	struct stat	stb;
+	mnt_entry	*mp;
+
+	for (mp = mnt_devhash[mnt_hash_dev(sbp->st_dev)]; mp; mp = mp->dev_next) {
+		if (mp->dev != sbp->st_dev)
+			continue;
+		if (!mp->root_known) {
+			if (mp->path[0] == '\0' || lstat(mp->path, &stb) < 0
+			 || stb.st_dev != mp->dev) {
+				mp->root_known = -1;
+			} else {
+				mp->root_known = 1;
+				mp->root_dev = stb.st_dev;
+				mp->root_ino = stb.st_ino;
+			}
+		}
+		if (mp->root_known > 0 && mp->root_ino == sbp->st_ino)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Given a directory PATH and its stat information, find out whether
+ * it is a mount point. Returns 0 if it is not; 1 if it is and the
+ * covered dev/ino has been stored in SBP; and MNT_UNKNOWN if the caller
+ * has to find out the hard way (and tell us through mnt_set_covered).
+ */
+int
+mnt_covered(const char *path, struct stat *sbp)
+{
+	mnt_entry	*mp;
+
+	mnt_refresh(0);
+	if (!mnt_available)
+		return MNT_UNKNOWN;
+
+	if ((mp = mnt_find_path(path)) != NULL) {
+		if (!mp->covered_valid
+		 || mp->root_dev != sbp->st_dev
+		 || mp->root_ino != sbp->st_ino)
+			return MNT_UNKNOWN;
+		sbp->st_dev = mp->covered_dev;
+		sbp->st_ino = mp->covered_ino;
+		return 1;
+	}
+
+	/* Not in our table under this name. If we know the device, it's
+	 * an ordinary directory, unless it is the root of a mount and
+	 * PATH isn't canonical (it goes through a symlink, for instance).
+	 * Otherwise, the table may be out of date. */
+	if (mnt_find_dev(sbp->st_dev) == NULL) {
+		if (!mnt_refresh(1) || mnt_find_path(path) != NULL
+		 || mnt_find_dev(sbp->st_dev) == NULL)
+			return MNT_UNKNOWN;
+	}
+	return mnt_is_root(sbp)? MNT_UNKNOWN : 0;
+}
+
+/*
+ * Remember the dev/ino covered by a mount point, as found by path_psi.
+ * PATH may not be a mount point at all, in which case we do nothing.
+ */
+void
+mnt_set_covered(const char *path, struct stat *sbp,
+			dev_t covered_dev, ino_t covered_ino)
+{
+	mnt_entry	*mp;
+
+	if (!mnt_available || (mp = mnt_find_path(path)) == NULL)
+		return;
+
+	/* Some file systems (btrfs, for instance) report a different
+	 * device number through stat than in the mount table. Go by
+	 * what stat tells us. */
+	if (mp->dev != sbp->st_dev) {
+		mnt_unhash_dev_entry(mp);
+		mp->dev = sbp->st_dev;
+		mnt_hash_dev_entry(mp);
+	}
+	mp->root_known = 1;
+	mp->root_dev = sbp->st_dev;
+	mp->root_ino = sbp->st_ino;
+	mp->covered_dev = covered_dev;
+	mp->covered_ino = covered_ino;
+	mp->covered_valid = 1;
+}
+
+/*
+ * File system types we consider remote (matched by prefix).
+ */
+static const char *	mnt_remote_types[] = {
+	"nfs", "smb", "cifs", "ncp", "afs", "coda", "9p", "ceph", NULL
+};
+
+/*
+ * Determine whether a file lives on a remote (NFS, SMB, ...) file
+ * system. Without a mount table, we guess that anything with a major
+ * device number of 0 is remote.
+ */
+int
+nfsmounted(const char *path, struct stat *sbp)
+{
+	mnt_entry	*mp;
+	int		i;
+
+	mnt_refresh(0);
+	if (mnt_available) {
+		if ((mp = mnt_find_dev(sbp->st_dev)) == NULL
+		 && mnt_refresh(1))
+			mp = mnt_find_dev(sbp->st_dev);
+		if (mp != NULL) {
+			for (i = 0; mnt_remote_types[i] != NULL; i++) {
+				if (!strncmp(mp->fstype, mnt_remote_types[i],
+					     strlen(mnt_remote_types[i])))
+					return 1;
+			}
+			return 0;
+		}
+	}
+#ifdef __linux__
+	return major(sbp->st_dev) == 0;
+#endif
+	return 0;
+}
@@ -0,0 +1,1203 @@
+/*
+ * nfs3.c	NFS version 3 server procedures.
+ *
+ *		Version 3 requests are served from the same file handle
+ *		cache and with the same authentication as version 2 ones;
+ *		mountd hands out the same 32 byte handles for both. What
+ *		clients gain is 64 bit sizes and offsets, attributes with
+ *		(almost) every reply so they need fewer GETATTRs, ACCESS,
+ *		READDIRPLUS, and unstable WRITEs that are committed to disk
+ *		in one go by a later COMMIT.
+ *
+ *		The resok and resfail arms of most results start with the
+ *		same members, so those are filled in through resok whatever
+ *		the outcome. LOOKUP and the calls creating a file are the
+ *		exception.
+ */
+
+#include "nfsd.h"
+#include "fsusage.h"
+
+static char		pathbuf[NFS_MAXPATHLEN + NFS_MAXNAMLEN + 1];
+static char		pathbuf_1[NFS_MAXPATHLEN + NFS_MAXNAMLEN + 1];
+static nfs_fh		newfh;		/* handle returned by LOOKUP etc */
+static writeverf3	write_verf;
+
+/*
+ * State of a READDIR or READDIRPLUS in progress.
+ */
+typedef struct rd3state {
+	fhcache *		h;
+	DIR *			dirp;
+	struct stat		sbuf;
+	int			dotsonly;
+	int			hidedot;
+	ino_t			dotinum;
+} rd3state;
+
+/*
+ * The write verifier changes when the server restarts, which tells
+ * clients to send again what they haven't committed yet.
+ */
+void
+nfs3_init(void)
+{
+	time_t	now = time(NULL);
+
+	memset(write_verf, 0, sizeof(write_verf));
+	memcpy(write_verf, &now, MIN(sizeof(now), sizeof(write_verf)));
+}
+
+/*
+ * Version 3 knows a few more errors than version 2.
+ */
+static nfsstat3
+nfs3_errno(void)
+{
+	switch (errno) {
+	case EXDEV:
+		return NFS3ERR_XDEV;
+	case EMLINK:
+		return NFS3ERR_MLINK;
+#ifdef EOPNOTSUPP
+	case EOPNOTSUPP:
+		return NFS3ERR_NOTSUPP;
+#endif
+	}
+	return (nfsstat3) nfs_errno();
+}
+
+/*
+ * Check the size of a version 3 handle and authenticate it.
+ */
+static fhcache *
+auth_fh3(struct svc_req *rqstp, nfs_fh3 *fh3, nfsstat3 *statp, int flags)
+{
+	fhcache	*fhc;
+	nfsstat	status;
+
+	if (fh3->data.data_len != NFS_FHSIZE) {
+		*statp = NFS3ERR_BADHANDLE;
+		return NULL;
+	}
+	fhc = auth_fh(rqstp, (nfs_fh *) fh3->data.data_val, &status, flags);
+	*statp = (nfsstat3) status;
+	return fhc;
+}
+
+static nfsstat3
+fh3_dirop(diropargs3 *dopa3, diropargs *dopa)
+{
+	if (dopa3->dir.data.data_len != NFS_FHSIZE)
+		return NFS3ERR_BADHANDLE;
+	memcpy(&dopa->dir, dopa3->dir.data.data_val, NFS_FHSIZE);
+	dopa->name = dopa3->name;
+	return NFS3_OK;
+}
+
+static void
+fh3_set(nfs_fh3 *fh3, nfs_fh *fh)
+{
+	fh3->data.data_len = NFS_FHSIZE;
+	fh3->data.data_val = (char *) fh;
+}
+
+/*
+ * The attributes auth_fh has just fetched, if they're still good.
+ */
+static struct stat *
+fhc_attrs(fhcache *fhc)
+{
+	return (fhc->flags & FHC_ATTRVALID) ? &fhc->attrs : NULL;
+}
+
+/*
+ * Fill in the pre-operation attributes of a wcc_data from those
+ * auth_fh has just fetched.
+ */
+static void
+wcc_before(wcc_data *wcc, fhcache *fhc)
+{
+	wcc_attr	*wa = &wcc->before.pre_op_attr_u.attributes;
+
+	if (!(fhc->flags & FHC_ATTRVALID))
+		return;
+	wa->size = fhc->attrs.st_size;
+	wa->mtime.seconds = fhc->attrs.st_mtime;
+	wa->mtime.nseconds = 0;
+	wa->ctime.seconds = fhc->attrs.st_ctime;
+	wa->ctime.nseconds = 0;
+	if (fhc->wb != NULL) {
+		if (wa->size < fhc->wb->offset + fhc->wb->len)
+			wa->size = fhc->wb->offset + fhc->wb->len;
+		wa->mtime.seconds = fhc->wb->mtime;
+		wa->ctime.seconds = fhc->wb->mtime;
+	}
+	wcc->before.attributes_follow = TRUE;
+}
+
+/*
+ * Fill in post-operation attributes. These are optional, so failure
+ * to get them isn't an error.
+ */
+static void
+post_attr(post_op_attr *pa, fhcache *fhc, struct stat *sbp,
+				struct svc_req *rqstp)
+{
+	if (fhc != NULL && fhc_getattr3(fhc, &pa->post_op_attr_u.attributes,
+						sbp, rqstp) == NFS_OK)
+		pa->attributes_follow = TRUE;
+}
+
+/*
+ * Return the handle and attributes of a file just created.
+ */
+static void
+post_fh(post_op_fh3 *pfh, post_op_attr *pa, nfs_fh *fh, struct stat *sbp,
+				struct svc_req *rqstp)
+{
+	pfh->handle_follows = TRUE;
+	fh3_set(&pfh->post_op_fh3_u.handle, fh);
+	post_attr(pa, fh_find((svc_fh *) fh, FHFIND_FEXISTS), sbp, rqstp);
+}
+
+/*
+ * Build the full path name for a file specified by diropargs3, and
+ * note the directory's attributes before we change it.
+ */
+static nfsstat3
+build_path3(struct svc_req *rqstp, char *buf, diropargs3 *dopa3, int flags,
+				fhcache **dirp, wcc_data *wcc)
+{
+	diropargs	dopa;
+	nfsstat3	status;
+
+	*dirp = NULL;
+	if ((status = fh3_dirop(dopa3, &dopa)) != NFS3_OK)
+		return status;
+	status = (nfsstat3) build_path(rqstp, buf, &dopa, flags, dirp);
+	if (*dirp != NULL)
+		wcc_before(wcc, *dirp);
+	return status;
+}
+
+/*
+ * Work out what the current user may do with a file from its mode
+ * bits. This mirrors path_open, which lets owners read and write their
+ * files whatever the mode, and anyone read files executable by others.
+ */
+static unsigned int
+access3(struct stat *s, unsigned int want)
+{
+	unsigned int	bits, res = 0;
+	int		i;
+
+	if (auth_uid == ROOT_UID) {
+		bits = 07;
+		if (!S_ISDIR(s->st_mode) && !(s->st_mode & 0111))
+			bits = 06;
+	} else if (s->st_uid == auth_uid) {
+		bits = (s->st_mode >> 6) & 07;
+		if (S_ISREG(s->st_mode))
+			bits |= 06;
+	} else {
+		for (i = 0; i < auth_gidlen; i++)
+			if (auth_gids[i] == s->st_gid)
+				break;
+		if (s->st_gid == auth_gid || i < auth_gidlen)
+			bits = (s->st_mode >> 3) & 07;
+		else
+			bits = s->st_mode & 07;
+	}
+	if (S_ISREG(s->st_mode) && (s->st_mode & S_IXOTH))
+		bits |= 04;
+
+	if (bits & 04)
+		res |= ACCESS3_READ;
+	if (S_ISDIR(s->st_mode)) {
+		if (bits & 01)
+			res |= ACCESS3_LOOKUP;
+		if ((bits & 03) == 03)
+			res |= ACCESS3_MODIFY | ACCESS3_EXTEND | ACCESS3_DELETE;
+	} else {
+		if (bits & 02)
+			res |= ACCESS3_MODIFY | ACCESS3_EXTEND;
+		if (bits & 01)
+			res |= ACCESS3_EXECUTE;
+	}
+	if (nfsmount->o.read_only || read_only)
+		res &= ~(ACCESS3_MODIFY | ACCESS3_EXTEND | ACCESS3_DELETE);
+
+	return res & want;
+}
+
+/*
+ * The "wrappers" of the following functions are modelled on the
+ * version 2 ones in nfsd.c.
+ */
+int
+nfsd_nfsproc3_null_3(void *argp, struct svc_req *rqstp)
+{
+	return (0);
+}
+
+int
+nfsd_nfsproc3_getattr_3(GETATTR3args *argp, struct svc_req *rqstp)
+{
+	GETATTR3resok	*ok = &result.getattr3res.GETATTR3res_u.resok;
+	nfsstat3	status;
+	fhcache		*fhc;
+
+	fhc = auth_fh3(rqstp, &argp->object, &status, CHK_READ | CHK_ROOT);
+	if (fhc == NULL)
+		return status;
+	fh_wb_flush(fhc);
+
+	return (fhc_getattr3(fhc, &ok->obj_attributes, fhc_attrs(fhc), rqstp));
+}
+
+int
+nfsd_nfsproc3_setattr_3(SETATTR3args *argp, struct svc_req *rqstp)
+{
+	wcc_data	*wcc = &result.setattr3res.SETATTR3res_u.resok.obj_wcc;
+	sattr3		*sa = &argp->new_attributes;
+	nfsstat3	status;
+	fhcache		*fhc;
+	struct stat	buf;
+
+	fhc = auth_fh3(rqstp, &argp->object, &status,
+					CHK_WRITE | CHK_NOACCESS);
+	if (fhc == NULL)
+		return status;
+	fh_wb_flush(fhc);
+
+	errno = 0;
+	if (efs_lstat(fhc->path, &buf) < 0)
+		return (nfs3_errno());
+	fhc->attrs = buf;
+	fhc->flags |= FHC_ATTRVALID;
+	wcc_before(wcc, fhc);
+
+	if (argp->guard.check
+	 && argp->guard.sattrguard3_u.obj_ctime.seconds != buf.st_ctime)
+		return (NFS3ERR_NOT_SYNC);
+
+	status = (nfsstat3) setattr3(fhc->path, sa, &buf, rqstp, SATTR_ALL);
+	if (sa->mode.set_it || sa->uid.set_it || sa->gid.set_it)
+		fh_perm_flush(fhc);
+
+	post_attr(&wcc->after, fhc, NULL, rqstp);
+	return (status);
+}
+
+int
+nfsd_nfsproc3_lookup_3(LOOKUP3args *argp, struct svc_req *rqstp)
+{
+	LOOKUP3res	*res = &result.lookup3res;
+	LOOKUP3resok	*ok = &res->LOOKUP3res_u.resok;
+	diropargs	dopa;
+	fhcache		*dirh, *fhc;
+	nfsstat3	status;
+	struct stat	dbuf, *dsp = NULL, sbuf;
+
+	if ((status = fh3_dirop(&argp->what, &dopa)) != NFS3_OK)
+		return status;
+	if (!(dirh = auth_fh(rqstp, &dopa.dir, (nfsstat *) &status, CHK_READ)))
+		return status;
+	if (dirh->flags & FHC_ATTRVALID) {
+		dbuf = dirh->attrs;
+		dsp = &dbuf;
+	}
+
+	status = (nfsstat3) fh_compose(&dopa, &newfh, &sbuf, -1, -1, 0);
+	if (status != NFS3_OK) {
+		post_attr(&res->LOOKUP3res_u.resfail.dir_attributes,
+						dirh, dsp, rqstp);
+		return status;
+	}
+
+	fhc = auth_fh(rqstp, &newfh, (nfsstat *) &status, CHK_READ);
+	if (fhc == NULL)
+		return status;
+
+	/* fh_compose doesn't stat the file on a name cache hit, but
+	 * auth_fh has just done so. */
+	if (sbuf.st_nlink == 0 && (fhc->flags & FHC_ATTRVALID))
+		sbuf = fhc->attrs;
+
+	fh3_set(&ok->object, &newfh);
+	post_attr(&ok->obj_attributes, fhc, &sbuf, rqstp);
+	post_attr(&ok->dir_attributes, dirh, dsp, rqstp);
+	Dprintf(D_CALL, "\tnew_fh = %s\n", fh_pr(&newfh));
+	return (NFS3_OK);
+}
+
+int
+nfsd_nfsproc3_access_3(ACCESS3args *argp, struct svc_req *rqstp)
+{
+	ACCESS3resok	*ok = &result.access3res.ACCESS3res_u.resok;
+	nfsstat3	status;
+	fhcache		*fhc;
+	struct stat	sbuf, *sbp;
+
+	fhc = auth_fh3(rqstp, &argp->object, &status, CHK_READ);
+	if (fhc == NULL)
+		return status;
+
+	if ((sbp = fhc_attrs(fhc)) == NULL) {
+		if (efs_lstat(fhc->path, &sbuf) < 0)
+			return (nfs3_errno());
+		sbp = &sbuf;
+	}
+	ok->access = access3(sbp, argp->access);
+	post_attr(&ok->obj_attributes, fhc, sbp, rqstp);
+	Dprintf(D_CALL, "\taccess %x of %x\n", ok->access, argp->access);
+	return (NFS3_OK);
+}
+
+int
+nfsd_nfsproc3_readlink_3(READLINK3args *argp, struct svc_req *rqstp)
+{
+	READLINK3resok	*ok = &result.readlink3res.READLINK3res_u.resok;
+	nfsstat3	status;
+	fhcache		*fhc;
+
+	fhc = auth_fh3(rqstp, &argp->symlink, &status,
+					CHK_READ | CHK_NOACCESS);
+	if (fhc == NULL)
+		return status;
+	post_attr(&ok->symlink_attributes, fhc, fhc_attrs(fhc), rqstp);
+
+	if ((status = (nfsstat3) fhc_readlink(fhc, pathbuf)) != NFS3_OK)
+		return status;
+	ok->data = pathbuf;
+	Dprintf(D_CALL, " %s\n", ok->data);
+	return (NFS3_OK);
+}
+
+int
+nfsd_nfsproc3_read_3(READ3args *argp, struct svc_req *rqstp)
+{
+	READ3resok	*ok = &result.read3res.READ3res_u.resok;
+	nfsstat3	status;
+	fhcache		*fhc;
+	struct stat	sbuf, *sbp;
+	char		*buf;
+	int		fd, count, len;
+
+	fhc = auth_fh3(rqstp, &argp->file, &status, CHK_READ | CHK_NOACCESS);
+	if (fhc == NULL)
+		return status;
+	fh_wb_flush(fhc);
+
+	if ((fd = fh_fd(fhc, (nfsstat *) &status, O_RDONLY)) < 0) {
+		post_attr(&ok->file_attributes, fhc, fhc_attrs(fhc), rqstp);
+		return status;
+	}
+
+	if ((count = argp->count) > nfsd_xfersize(rqstp))
+		count = nfsd_xfersize(rqstp);
+	if ((buf = iobuf_get(count)) == NULL) {
+		errno = EIO;
+		len = -1;
+	} else {
+		len = bc_read(fhc, fd, buf, count, (off_t) argp->offset);
+	}
+	if (len < 0) {
+		status = nfs3_errno();
+		fd_inactive(fd);
+		post_attr(&ok->file_attributes, fhc, fhc_attrs(fhc), rqstp);
+		return status;
+	}
+	if ((sbp = fhc_attrs(fhc)) == NULL && efs_fstat(fd, &sbuf) >= 0)
+		sbp = &sbuf;
+	fd_inactive(fd);
+
+	ok->count = len;
+	ok->data.data_len = len;
+	ok->data.data_val = buf;
+	ok->eof = (len < count
+		|| (sbp != NULL && argp->offset + len >= sbp->st_size));
+
+	/* Write record to syslog */
+	if (argp->offset == 0 && log_transfers)
+		nfsd_xferlog(rqstp, "<", fhc->path);
+
+	post_attr(&ok->file_attributes, fhc, sbp, rqstp);
+	return (NFS3_OK);
+}
+
+/*
+ * UNSTABLE writes just go to the file. We commit the others before
+ * replying, except on async exports, where everything is left to the
+ * write-behind buffer and we only pretend the data is stable.
+ */
+int
+nfsd_nfsproc3_write_3(WRITE3args *argp, struct svc_req *rqstp)
+{
+	WRITE3resok	*ok = &result.write3res.WRITE3res_u.resok;
+	nfsstat3	status;
+	fhcache		*fhc;
+	int		fd, len;
+
+	fhc = auth_fh3(rqstp, &argp->file, &status, CHK_WRITE | CHK_NOACCESS);
+	if (fhc == NULL)
+		return status;
+	wcc_before(&ok->file_wcc, fhc);
+
+	if (argp->count > argp->data.data_len) {
+		Dprintf(L_NOTICE,
+			"strange write req from %s: count %u, len %u",
+			nfsclient->clnt_name, argp->count,
+			argp->data.data_len);
+		return NFS3ERR_INVAL;
+	}
+
+	if ((fd = fh_fd(fhc, (nfsstat *) &status, O_WRONLY)) < 0)
+		goto done;
+
+	/* On async exports, leave the data in the write-behind buffer.
+	 * Otherwise, make sure no buffered data overwrites it later;
+	 * if that fails, the error goes to the next COMMIT. */
+	len = 0;
+	if (nfsmount->o.async && fh_wb_max > 0)
+		len = fh_wb_write(fhc, fd, argp->data.data_val,
+				argp->count, (off_t) argp->offset);
+	else
+		fh_wb_flush(fhc);
+	if (len > 0)
+		len = argp->count;
+	else
+		len = efs_pwrite(fd, argp->data.data_val, argp->count,
+						(off_t) argp->offset);
+	if (len >= 0 && argp->stable != UNSTABLE && !nfsmount->o.async) {
+		if ((argp->stable == FILE_SYNC ?
+		     efs_fsync(fd) : efs_fdatasync(fd)) < 0)
+			len = -1;
+	}
+	if (len < 0) {
+		Dprintf(D_CALL, "Write failure, errno is %d.\n", errno);
+		status = nfs3_errno();
+		fd_inactive(fd);
+		goto done;
+	}
+	fh_io_hint(fhc, fd, (off_t) argp->offset, len, 1);
+
+	/* Get the post-op attributes from the open file rather than
+	 * looking up the path again. */
+	fhc->flags &= ~FHC_ATTRVALID;
+	if (efs_fstat(fd, &fhc->attrs) >= 0)
+		fhc->flags |= FHC_ATTRVALID;
+	fd_inactive(fd);
+
+	/* Write record to syslog */
+	if (argp->offset == 0 && log_transfers)
+		nfsd_xferlog(rqstp, ">", fhc->path);
+
+	ok->count = len;
+	ok->committed = argp->stable;
+	memcpy(ok->verf, write_verf, sizeof(write_verf));
+	status = NFS3_OK;
+
+done:
+	post_attr(&ok->file_wcc.after, fhc, fhc_attrs(fhc), rqstp);
+	return (status);
+}
+
+/*
+ * Only regular files are created here; MKNOD does the others. For
+ * EXCLUSIVE creates, the client's verifier is kept in atime and mtime
+ * until it sets the real attributes, so we recognize a retransmission.
+ */
+int
+nfsd_nfsproc3_create_3(CREATE3args *argp, struct svc_req *rqstp)
+{
+	CREATE3res	*res = &result.create3res;
+	CREATE3resok	*ok = &res->CREATE3res_u.resok;
+	createhow3	*how = &argp->how;
+	sattr3		*sa = &how->createhow3_u.obj_attributes;
+	diropargs	dopa;
+	wcc_data	wcc;
+	fhcache		*dirh;
+	nfsstat3	status;
+	struct stat	sbuf;
+	__u32		verf[2];
+	int		fd = -1, flags, mode, exists;
+
+	memset(&wcc, 0, sizeof(wcc));
+	memcpy(verf, how->createhow3_u.verf, sizeof(verf));
+	status = build_path3(rqstp, pathbuf, &argp->where,
+				CHK_WRITE | CHK_NOACCESS, &dirh, &wcc);
+	if (status != NFS3_OK)
+		goto done;
+	Dprintf(D_CALL, "\tfullpath='%s'\n", pathbuf);
+
+	errno = 0;
+	exists = efs_lstat(pathbuf, &sbuf) == 0;
+	if (exists && how->mode != UNCHECKED) {
+		if (how->mode == EXCLUSIVE && S_ISREG(sbuf.st_mode)
+		 && sbuf.st_atime == verf[0] && sbuf.st_mtime == verf[1])
+			goto compose;
+		status = NFS3ERR_EXIST;
+		goto done;
+	}
+
+	mode = 0644;
+	if (how->mode != EXCLUSIVE && sa->mode.set_it)
+		mode = sa->mode.set_mode3_u.mode & 07777;
+	flags = O_WRONLY;
+	if (!exists)
+		flags |= (how->mode == UNCHECKED) ? O_CREAT : O_CREAT|O_EXCL;
+	else
+		fh_wb_flush_path(pathbuf);
+	if ((fd = path_open(pathbuf, flags, mode)) < 0) {
+		status = nfs3_errno();
+		goto done;
+	}
+	(void) efs_fstat(fd, &sbuf);
+
+	if (how->mode == EXCLUSIVE) {
+		struct timeval	tvp[2];
+
+		tvp[0].tv_sec = verf[0];
+		tvp[1].tv_sec = verf[1];
+		tvp[0].tv_usec = tvp[1].tv_usec = 0;
+		if (efs_utimes(pathbuf, tvp) < 0) {
+			status = nfs3_errno();
+			goto done;
+		}
+		sbuf.st_atime = verf[0];
+		sbuf.st_mtime = verf[1];
+	} else if (!exists) {
+#ifndef ALLOW_SGIDDIR
+		sa->gid.set_it = FALSE;
+#endif
+		status = (nfsstat3) setattr3(pathbuf, sa, &sbuf, rqstp,
+					SATTR_ALL & ~SATTR_SIZE);
+	} else {
+		status = (nfsstat3) setattr3(pathbuf, sa, &sbuf, rqstp,
+					SATTR_SIZE);
+	}
+	if (status != NFS3_OK)
+		goto done;
+
+	if (!exists)
+		fh_dir_modified(pathbuf);
+
+compose:
+	fh3_dirop(&argp->where, &dopa);
+	status = (nfsstat3) fh_compose(&dopa, &newfh, &sbuf, fd,
+					fd >= 0 ? O_WRONLY : -1, 0);
+	if (status != NFS3_OK)
+		goto done;
+	fd = -1;		/* fd now stored in fh cache */
+	post_fh(&ok->obj, &ok->obj_attributes, &newfh, &sbuf, rqstp);
+	Dprintf(D_CALL, "\tnew_fh = %s\n", fh_pr(&newfh));
+
+done:
+	if (fd >= 0)
+		efs_close(fd);
+	post_attr(&wcc.after, dirh, NULL, rqstp);
+	if (status == NFS3_OK)
+		ok->dir_wcc = wcc;
+	else
+		res->CREATE3res_u.resfail.dir_wcc = wcc;
+	return (status);
+}
+
+int
+nfsd_nfsproc3_mkdir_3(MKDIR3args *argp, struct svc_req *rqstp)
+{
+	MKDIR3res	*res = &result.mkdir3res;
+	MKDIR3resok	*ok = &res->MKDIR3res_u.resok;
+	sattr3		*sa = &argp->attributes;
+	diropargs	dopa;
+	wcc_data	wcc;
+	fhcache		*dirh;
+	nfsstat3	status;
+	struct stat	sbuf, cbuf;
+
+	memset(&wcc, 0, sizeof(wcc));
+	status = build_path3(rqstp, pathbuf, &argp->where,
+				CHK_WRITE | CHK_NOACCESS, &dirh, &wcc);
+	if (status != NFS3_OK)
+		goto done;
+	Dprintf(D_CALL, "\tfullpath='%s'\n", pathbuf);
+
+	if (efs_mkdir(pathbuf, sa->mode.set_it ?
+			sa->mode.set_mode3_u.mode & 07777 : 0755) != 0
+	 || efs_lstat(pathbuf, &sbuf) != 0) {
+		status = nfs3_errno();
+		goto done;
+	}
+	fh_dir_modified(pathbuf);
+
+#ifndef ALLOW_SGIDDIR
+	sa->gid.set_it = FALSE;
+#endif
+	/* Inherit setgid bit from directory */
+	if (sa->mode.set_it)
+		sa->mode.set_mode3_u.mode |= (sbuf.st_mode & S_ISGID);
+	status = (nfsstat3) setattr3(pathbuf, sa, &sbuf, rqstp,
+				SATTR_CHOWN|SATTR_CHMOD|SATTR_UTIMES);
+	if (status != NFS3_OK)
+		goto done;
+
+	fh3_dirop(&argp->where, &dopa);
+	status = (nfsstat3) fh_compose(&dopa, &newfh, &cbuf, -1, -1, 0);
+	if (status != NFS3_OK)
+		goto done;
+	post_fh(&ok->obj, &ok->obj_attributes, &newfh, NULL, rqstp);
+	Dprintf(D_CALL, "\tnew_fh = %s\n", fh_pr(&newfh));
+
+done:
+	post_attr(&wcc.after, dirh, NULL, rqstp);
+	if (status == NFS3_OK)
+		ok->dir_wcc = wcc;
+	else
+		res->MKDIR3res_u.resfail.dir_wcc = wcc;
+	return (status);
+}
+
+int
+nfsd_nfsproc3_symlink_3(SYMLINK3args *argp, struct svc_req *rqstp)
+{
+	SYMLINK3res	*res = &result.symlink3res;
+	SYMLINK3resok	*ok = &res->SYMLINK3res_u.resok;
+	sattr3		*sa = &argp->symlink.symlink_attributes;
+	diropargs	dopa;
+	wcc_data	wcc;
+	fhcache		*dirh;
+	nfsstat3	status;
+	struct stat	sbuf;
+
+	memset(&wcc, 0, sizeof(wcc));
+	status = build_path3(rqstp, pathbuf, &argp->where,
+				CHK_WRITE | CHK_NOACCESS, &dirh, &wcc);
+	if (status != NFS3_OK)
+		goto done;
+	Dprintf(D_CALL, "\tstring='%s' filename='%s'\n",
+			argp->symlink.symlink_data, pathbuf);
+
+	if (efs_symlink(argp->symlink.symlink_data, pathbuf) != 0) {
+		status = nfs3_errno();
+		goto done;
+	}
+	fh_dir_modified(pathbuf);
+
+	/* Setting the times would follow the link, so only the owner
+	 * can be changed. */
+#ifndef ALLOW_SGIDDIR
+	sa->gid.set_it = FALSE;
+#endif
+	status = (nfsstat3) setattr3(pathbuf, sa, NULL, rqstp, SATTR_CHOWN);
+	if (status != NFS3_OK)
+		goto done;
+
+	fh3_dirop(&argp->where, &dopa);
+	status = (nfsstat3) fh_compose(&dopa, &newfh, &sbuf, -1, -1, 0);
+	if (status != NFS3_OK)
+		goto done;
+	post_fh(&ok->obj, &ok->obj_attributes, &newfh, &sbuf, rqstp);
+
+done:
+	post_attr(&wcc.after, dirh, NULL, rqstp);
+	if (status == NFS3_OK)
+		ok->dir_wcc = wcc;
+	else
+		res->SYMLINK3res_u.resfail.dir_wcc = wcc;
+	return (status);
+}
+
+int
+nfsd_nfsproc3_mknod_3(MKNOD3args *argp, struct svc_req *rqstp)
+{
+	MKNOD3res	*res = &result.mknod3res;
+	MKNOD3resok	*ok = &res->MKNOD3res_u.resok;
+	mknoddata3	*what = &argp->what;
+	sattr3		*sa;
+	diropargs	dopa;
+	wcc_data	wcc;
+	fhcache		*dirh;
+	nfsstat3	status;
+	struct stat	sbuf;
+	dev_t		dev = 0;
+	int		mode;
+
+	memset(&wcc, 0, sizeof(wcc));
+	status = build_path3(rqstp, pathbuf, &argp->where,
+				CHK_WRITE | CHK_NOACCESS, &dirh, &wcc);
+	if (status != NFS3_OK)
+		goto done;
+	Dprintf(D_CALL, "\tfullpath='%s'\n", pathbuf);
+
+	switch (what->type) {
+	case NF3CHR:
+	case NF3BLK:
+		sa = &what->mknoddata3_u.device.dev_attributes;
+		mode = (what->type == NF3CHR) ? S_IFCHR : S_IFBLK;
+#ifdef makedev
+		dev = makedev(what->mknoddata3_u.device.spec.specdata1,
+			      what->mknoddata3_u.device.spec.specdata2);
+#else
+		dev = (what->mknoddata3_u.device.spec.specdata1 << 8)
+		    | what->mknoddata3_u.device.spec.specdata2;
+#endif
+		break;
+	case NF3SOCK:
+	case NF3FIFO:
+		sa = &what->mknoddata3_u.pipe_attributes;
+		mode = (what->type == NF3SOCK) ? S_IFSOCK : S_IFIFO;
+		break;
+	default:
+		status = NFS3ERR_BADTYPE;
+		goto done;
+	}
+	mode |= sa->mode.set_it ? sa->mode.set_mode3_u.mode & 07777 : 0644;
+
+	if (efs_mknod(pathbuf, mode, dev) < 0) {
+		status = nfs3_errno();
+		goto done;
+	}
+	fh_dir_modified(pathbuf);
+
+#ifndef ALLOW_SGIDDIR
+	sa->gid.set_it = FALSE;
+#endif
+	status = (nfsstat3) setattr3(pathbuf, sa, NULL, rqstp,
+				SATTR_CHOWN|SATTR_CHMOD|SATTR_UTIMES);
+	if (status != NFS3_OK)
+		goto done;
+
+	fh3_dirop(&argp->where, &dopa);
+	status = (nfsstat3) fh_compose(&dopa, &newfh, &sbuf, -1, -1, 0);
+	if (status != NFS3_OK)
+		goto done;
+	post_fh(&ok->obj, &ok->obj_attributes, &newfh, &sbuf, rqstp);
+
+done:
+	post_attr(&wcc.after, dirh, NULL, rqstp);
+	if (status == NFS3_OK)
+		ok->dir_wcc = wcc;
+	else
+		res->MKNOD3res_u.resfail.dir_wcc = wcc;
+	return (status);
+}
+
+int
+nfsd_nfsproc3_remove_3(REMOVE3args *argp, struct svc_req *rqstp)
+{
+	wcc_data	*wcc = &result.remove3res.REMOVE3res_u.resok.dir_wcc;
+	fhcache		*dirh;
+	nfsstat3	status;
+
+	status = build_path3(rqstp, pathbuf, &argp->object,
+				CHK_WRITE | CHK_NOACCESS, &dirh, wcc);
+	if (status == NFS3_OK) {
+		Dprintf(D_CALL, "\tfullpath='%s'\n", pathbuf);
+
+		/* Remove the file handle from our cache. */
+		fh_remove(pathbuf);
+		fh_dir_modified(pathbuf);
+
+		if (efs_unlink(pathbuf) != 0)
+			status = nfs3_errno();
+	}
+	post_attr(&wcc->after, dirh, NULL, rqstp);
+	return (status);
+}
+
+int
+nfsd_nfsproc3_rmdir_3(RMDIR3args *argp, struct svc_req *rqstp)
+{
+	wcc_data	*wcc = &result.rmdir3res.RMDIR3res_u.resok.dir_wcc;
+	fhcache		*dirh;
+	nfsstat3	status;
+
+	status = build_path3(rqstp, pathbuf, &argp->object,
+				CHK_WRITE | CHK_NOACCESS, &dirh, wcc);
+	if (status == NFS3_OK) {
+		Dprintf(D_CALL, "\tfullpath='%s'\n", pathbuf);
+
+		/* Remove that file handle from our cache. */
+		fh_remove(pathbuf);
+		fh_dir_modified(pathbuf);
+
+		if (efs_rmdir(pathbuf) != 0)
+			status = nfs3_errno();
+	}
+	post_attr(&wcc->after, dirh, NULL, rqstp);
+	return (status);
+}
+
+int
+nfsd_nfsproc3_rename_3(RENAME3args *argp, struct svc_req *rqstp)
+{
+	RENAME3resok	*ok = &result.rename3res.RENAME3res_u.resok;
+	fhcache		*fromdir, *todir = NULL;
+	nfsstat3	status;
+
+	status = build_path3(rqstp, pathbuf, &argp->from,
+			CHK_WRITE | CHK_NOACCESS, &fromdir, &ok->fromdir_wcc);
+	if (status == NFS3_OK)
+		status = build_path3(rqstp, pathbuf_1, &argp->to,
+			CHK_WRITE | CHK_NOACCESS, &todir, &ok->todir_wcc);
+	if (status == NFS3_OK) {
+		Dprintf(D_CALL, "\tpathfrom='%s' pathto='%s'\n",
+						pathbuf, pathbuf_1);
+
+		/* Remove the handle of the file being replaced. */
+		fh_remove(pathbuf_1);
+		fh_dir_modified(pathbuf);
+		fh_dir_modified(pathbuf_1);
+
+		if (efs_rename(pathbuf, pathbuf_1) != 0)
+			status = nfs3_errno();
+		else
+			fh_rename(pathbuf, pathbuf_1);
+	}
+	post_attr(&ok->fromdir_wcc.after, fromdir, NULL, rqstp);
+	post_attr(&ok->todir_wcc.after, todir, NULL, rqstp);
+	return (status);
+}
+
+int
+nfsd_nfsproc3_link_3(LINK3args *argp, struct svc_req *rqstp)
+{
+	LINK3resok	*ok = &result.link3res.LINK3res_u.resok;
+	nfs_mount	*mountp1;
+	fhcache		*fhc, *dirh;
+	nfsstat3	status;
+
+	fhc = auth_fh3(rqstp, &argp->file, &status, CHK_WRITE | CHK_NOACCESS);
+	if (fhc == NULL)
+		return status;
+	mountp1 = nfsmount;
+
+	status = build_path3(rqstp, pathbuf_1, &argp->link,
+			CHK_WRITE | CHK_NOACCESS, &dirh, &ok->linkdir_wcc);
+	if (status == NFS3_OK) {
+		Dprintf(D_CALL, "\tpathfrom='%s' pathto='%s'\n",
+						fhc->path, pathbuf_1);
+
+		/* See nfsd_nfsproc_link_2 */
+		if (nfsmount != mountp1) {
+			Dprintf(D_CALL, "\tdenied link between different "
+					"exports\n");
+			status = NFS3ERR_XDEV;
+		} else if (efs_link(fhc->path, pathbuf_1) != 0) {
+			status = nfs3_errno();
+		} else {
+			fh_dir_modified(pathbuf_1);
+		}
+	}
+	post_attr(&ok->file_attributes, fhc, NULL, rqstp);
+	post_attr(&ok->linkdir_wcc.after, dirh, NULL, rqstp);
+	return (status);
+}
+
+/*
+ * Open a directory for READDIR or READDIRPLUS and seek to the cookie.
+ * The rules about what to show are the same as in nfsd_nfsproc_readdir_2.
+ */
+static nfsstat3
+readdir3_open(struct svc_req *rqstp, nfs_fh3 *fh3, cookie3 cookie,
+				post_op_attr *attrp, rd3state *rd)
+{
+	nfsstat3	status;
+	fhcache		*h;
+
+	if ((h = auth_fh3(rqstp, fh3, &status, CHK_READ)) == NULL)
+		return status;
+
+	rd->h = h;
+	rd->dotsonly = ((!re_export && (h->flags & FHC_NFSMOUNTED))
+			|| nfsmount->o.noaccess);
+	rd->hidedot  = (nfsmount->parent == NULL
+			&& !strcmp(h->path, nfsmount->path));
+	rd->dotinum = 0;
+
+	errno = 0;
+	if (efs_lstat(h->path, &rd->sbuf) < 0)
+		return (NFS3ERR_ACCES);
+	post_attr(attrp, h, &rd->sbuf, rqstp);
+	if (!S_ISDIR(rd->sbuf.st_mode))
+		return (NFS3ERR_NOTDIR);
+	if ((rd->dirp = efs_opendir(h->path)) == NULL)
+		return ((errno ? nfs3_errno() : NFS3ERR_NAMETOOLONG));
+	if (cookie != 0)
+		efs_seekdir(rd->dirp, (long) cookie);
+	return (NFS3_OK);
+}
+
+/*
+ * Get the next entry to return, or NULL if there are no more.
+ */
+static struct dirent *
+readdir3_next(rd3state *rd)
+{
+	struct dirent	*dp;
+
+	if ((dp = efs_readdir(rd->dirp)) == NULL)
+		return NULL;
+
+	/* XXX: This code relies on . coming before .. */
+	if (!strcmp(dp->d_name, "..")) {
+		if (rd->hidedot)
+			dp->d_ino = rd->dotinum;
+	} else if (!strcmp(dp->d_name, ".")) {
+		rd->dotinum = dp->d_ino;
+	} else if (rd->dotsonly) {
+		return NULL;
+	}
+	return dp;
+}
+
+/* Size of an entry3 on the wire, plus the pointer before it */
+#define ENTRY3_SIZE(namlen)	(4 + 8 + 4 + (((namlen) + 3) & ~3) + 8)
+/* An entryplus3 also carries attributes and a handle */
+#define ENTRYPLUS3_SIZE(namlen)	(ENTRY3_SIZE(namlen) + 4 + 84 + 4 + 4 \
+					+ NFS_FHSIZE)
+/* Reply header, directory attributes, verifier and eof */
+#define READDIR3_OVERHEAD	(4 + 4 + 84 + 8 + 4 + 4)
+
+int
+nfsd_nfsproc3_readdir_3(READDIR3args *argp, struct svc_req *rqstp)
+{
+	static READDIR3res oldres;
+	READDIR3resok	*ok = &result.readdir3res.READDIR3res_u.resok;
+	entry3		**ep, *e;
+	struct dirent	*dp;
+	rd3state	rd;
+	unsigned int	count, res_size;
+	int		first, nprefetch;
+	nfsstat3	status;
+
+	/* Free the previous result, since it has 'malloc'ed strings.  */
+	xdr_free((xdrproc_t) xdr_READDIR3res, (caddr_t) &oldres);
+
+	status = readdir3_open(rqstp, &argp->dir, argp->cookie,
+					&ok->dir_attributes, &rd);
+	if (status != NFS3_OK)
+		return status;
+
+	if ((count = argp->count) > nfsd_xfersize(rqstp))
+		count = nfsd_xfersize(rqstp);
+	res_size = READDIR3_OVERHEAD;
+	first = 1;
+	nprefetch = 0;
+	ep = &ok->reply.entries;
+	while ((dp = readdir3_next(&rd)) != NULL) {
+		res_size += ENTRY3_SIZE(NLENGTH(dp));
+		if (res_size >= count && !first)
+			break;
+
+		e = *ep = (entry3 *) xmalloc(sizeof(entry3));
+		e->fileid = pseudo_inode(dp->d_ino, rd.sbuf.st_dev);
+		e->name = xmalloc(NLENGTH(dp) + 1);
+		strcpy(e->name, dp->d_name);
+		if (fh_prefetch && !rd.dotsonly && nprefetch++ < PREFETCH_MAX)
+			fh_prefetch_entry(rd.h, dirfd(rd.dirp), dp->d_name,
+						dp->d_ino, rd.sbuf.st_dev);
+		e->cookie = efs_telldir(rd.dirp);
+		ep = &e->nextentry;
+		first = 0;
+	}
+	*ep = NULL;
+	ok->reply.eof = (dp == NULL);
+	efs_closedir(rd.dirp);
+	oldres = result.readdir3res;
+	return (NFS3_OK);
+}
+
+/*
+ * Like READDIR, but with a handle and attributes for every entry, which
+ * saves the client a LOOKUP per file. We don't bother with dircount and
+ * fill the reply up to maxcount. The . and .. entries come without
+ * handles; the client can look those up if it wants.
+ */
+int
+nfsd_nfsproc3_readdirplus_3(READDIRPLUS3args *argp, struct svc_req *rqstp)
+{
+	static READDIRPLUS3res oldres;
+	READDIRPLUS3resok *ok = &result.readdirplus3res.READDIRPLUS3res_u.resok;
+	entryplus3	**ep, *e;
+	struct dirent	*dp;
+	struct stat	sbuf;
+	diropargs	dopa;
+	fhcache		*fhc;
+	nfs_fh		fh;
+	rd3state	rd;
+	unsigned int	count, res_size;
+	int		first;
+	nfsstat3	status;
+
+	/* Free the previous result, since it has 'malloc'ed strings.  */
+	xdr_free((xdrproc_t) xdr_READDIRPLUS3res, (caddr_t) &oldres);
+
+	status = readdir3_open(rqstp, &argp->dir, argp->cookie,
+					&ok->dir_attributes, &rd);
+	if (status != NFS3_OK)
+		return status;
+	memcpy(&dopa.dir, argp->dir.data.data_val, NFS_FHSIZE);
+
+	if ((count = argp->maxcount) > nfsd_xfersize(rqstp))
+		count = nfsd_xfersize(rqstp);
+	res_size = READDIR3_OVERHEAD;
+	first = 1;
+	ep = &ok->reply.entries;
+	while ((dp = readdir3_next(&rd)) != NULL) {
+		res_size += ENTRYPLUS3_SIZE(NLENGTH(dp));
+		if (res_size >= count && !first)
+			break;
+
+		e = *ep = (entryplus3 *) xmalloc(sizeof(entryplus3));
+		memset(e, 0, sizeof(*e));
+		e->fileid = pseudo_inode(dp->d_ino, rd.sbuf.st_dev);
+		e->name = xmalloc(NLENGTH(dp) + 1);
+		strcpy(e->name, dp->d_name);
+		e->cookie = efs_telldir(rd.dirp);
+		ep = &e->nextentry;
+		first = 0;
+
+		if (rd.dotsonly || !strcmp(e->name, ".")
+		 || !strcmp(e->name, ".."))
+			continue;
+		dopa.name = e->name;
+		if (fh_compose(&dopa, &fh, &sbuf, -1, -1, 0) != NFS_OK
+		 || (fhc = fh_find((svc_fh *) &fh, FHFIND_FEXISTS)) == NULL)
+			continue;
+		e->name_handle.handle_follows = TRUE;
+		e->name_handle.post_op_fh3_u.handle.data.data_len = NFS_FHSIZE;
+		e->name_handle.post_op_fh3_u.handle.data.data_val =
+						xmalloc(NFS_FHSIZE);
+		memcpy(e->name_handle.post_op_fh3_u.handle.data.data_val,
+						&fh, NFS_FHSIZE);
+		post_attr(&e->name_attributes, fhc, &sbuf, rqstp);
+	}
+	*ep = NULL;
+	ok->reply.eof = (dp == NULL);
+	efs_closedir(rd.dirp);
+	oldres = result.readdirplus3res;
+	return (NFS3_OK);
+}
+
+int
+nfsd_nfsproc3_fsstat_3(FSSTAT3args *argp, struct svc_req *rqstp)
+{
+	FSSTAT3resok	*ok = &result.fsstat3res.FSSTAT3res_u.resok;
+	nfsstat3	status;
+	fhcache		*fhc;
+	struct fs_usage	fs;
+
+	fhc = auth_fh3(rqstp, &argp->fsroot, &status,
+				CHK_READ | CHK_NOACCESS | CHK_ROOT);
+	if (fhc == NULL)
+		return status;
+	post_attr(&ok->obj_attributes, fhc, fhc_attrs(fhc), rqstp);
+
+	if (get_fs_usage(fhc->path, NULL, &fs) < 0)
+		return (nfs3_errno());
+	ok->tbytes = (size3) fs.fsu_blocks * 512;
+	ok->fbytes = (size3) fs.fsu_bfree * 512;
+	ok->abytes = (size3) fs.fsu_bavail * 512;
+	ok->tfiles = fs.fsu_files;
+	ok->ffiles = fs.fsu_ffree;
+	ok->afiles = fs.fsu_ffree;
+	ok->invarsec = 0;
+
+	return (NFS3_OK);
+}
+
+int
+nfsd_nfsproc3_fsinfo_3(FSINFO3args *argp, struct svc_req *rqstp)
+{
+	FSINFO3resok	*ok = &result.fsinfo3res.FSINFO3res_u.resok;
+	nfsstat3	status;
+	fhcache		*fhc;
+
+	fhc = auth_fh3(rqstp, &argp->fsroot, &status,
+				CHK_READ | CHK_NOACCESS | CHK_ROOT);
+	if (fhc == NULL)
+		return status;
+	post_attr(&ok->obj_attributes, fhc, fhc_attrs(fhc), rqstp);
+
+	/* Clients ask for FSINFO over the transport they're going
+	 * to use, so we can tell UDP clients their limit. */
+	ok->rtmax = ok->rtpref = nfsd_xfersize(rqstp);
+	ok->rtmult = 512;
+	ok->wtmax = ok->wtpref = nfsd_xfersize(rqstp);
+	ok->wtmult = 512;
+	ok->dtpref = nfsd_xfersize(rqstp);
+	ok->maxfilesize = ~(size3) 0 >> 1;
+	ok->time_delta.seconds = 1;	/* we don't do nanoseconds */
+	ok->time_delta.nseconds = 0;
+	ok->properties = FSF3_LINK | FSF3_SYMLINK | FSF3_HOMOGENEOUS
+			| FSF3_CANSETTIME;
+
+	return (NFS3_OK);
+}
+
+int
+nfsd_nfsproc3_pathconf_3(PATHCONF3args *argp, struct svc_req *rqstp)
+{
+	PATHCONF3resok	*ok = &result.pathconf3res.PATHCONF3res_u.resok;
+	nfsstat3	status;
+	fhcache		*fhc;
+	long		linkmax;
+
+	fhc = auth_fh3(rqstp, &argp->object, &status, CHK_READ);
+	if (fhc == NULL)
+		return status;
+	post_attr(&ok->obj_attributes, fhc, fhc_attrs(fhc), rqstp);
+
+	if ((linkmax = pathconf(fhc->path, _PC_LINK_MAX)) <= 0)
+		linkmax = _POSIX_LINK_MAX;
+	ok->linkmax = linkmax;
+	ok->name_max = NFS_MAXNAMLEN;
+	ok->no_trunc = TRUE;
+	ok->chown_restricted = TRUE;
+	ok->case_insensitive = FALSE;
+	ok->case_preserving = TRUE;
+
+	return (NFS3_OK);
+}
+
+/*
+ * Write out what's left in the write-behind buffer and commit the
+ * file. On async exports, there's nothing to commit.
+ */
+int
+nfsd_nfsproc3_commit_3(COMMIT3args *argp, struct svc_req *rqstp)
+{
+	COMMIT3resok	*ok = &result.commit3res.COMMIT3res_u.resok;
+	nfsstat3	status;
+	fhcache		*fhc;
+	int		fd;
+
+	fhc = auth_fh3(rqstp, &argp->file, &status, CHK_READ | CHK_NOACCESS);
+	if (fhc == NULL)
+		return status;
+	wcc_before(&ok->file_wcc, fhc);
+
+	/* Report errors from writing out data buffered earlier */
+	fh_wb_flush(fhc);
+	if (fhc->wb_error) {
+		errno = fhc->wb_error;
+		fhc->wb_error = 0;
+		status = nfs3_errno();
+	} else if (!nfsmount->o.async) {
+		if ((fd = fh_fd(fhc, (nfsstat *) &status, O_WRONLY)) < 0)
+			fd = fh_fd(fhc, (nfsstat *) &status, O_RDONLY);
+		if (fd >= 0) {
+			status = NFS3_OK;
+			if (efs_fdatasync(fd) < 0)
+				status = nfs3_errno();
+			fd_inactive(fd);
+		}
+	}
+	memcpy(ok->verf, write_verf, sizeof(write_verf));
+
+	post_attr(&ok->file_wcc.after, fhc, NULL, rqstp);
+	return (status);
+}
@@ -50,6 +50,14 @@ time_t			nfs_dispatch_time;
 	STRING(funct), CONCAT(pr_,arg_type)			\
 }
 
+#define table_ent3(res_type, arg_type, funct, pr) {		\
+	sizeof(res_type), sizeof(arg_type),			\
+	(xdrproc_t) CONCAT(xdr_,res_type),			\
+	(xdrproc_t) CONCAT(xdr_,arg_type),			\
+	(int (*)()) CONCAT3(nfsd_nfsproc3_,funct,_3),		\
+	STRING(funct), pr					\
+}
+
 /* This definition makes the first table entry use xdr_char instead of
  * xdr_void. The NULL procedure call over TCP fails for this reason
 #define nil	char
@@ -79,6 +87,11 @@ static char *pr_renameargs(renameargs *argp);
 static char *pr_linkargs(linkargs *argp);
 static char *pr_symlinkargs(symlinkargs *argp);
 static char *pr_readdirargs(readdirargs *argp);
+static char *pr_nfs_fh3(nfs_fh3 *argp);
+static char *pr_diropargs3(diropargs3 *argp);
+static char *pr_READ3args(READ3args *argp);
+static char *pr_WRITE3args(WRITE3args *argp);
+static char *pr_RENAME3args(RENAME3args *argp);
 
 static struct dispatch_entry dtable[] = {
 	table_ent(nil,nil,null),			/* NULL */
@@ -101,6 +114,34 @@ static struct dispatch_entry dtable[] = {
 	table_ent(statfsres,nfs_fh,statfs),		/* STATFS */
 };
 
+/* Version 3. All arguments except those of NULL, LINK, READ, WRITE
+ * and RENAME start with the handle or the diropargs3 of the object. */
+static struct dispatch_entry dtable3[] = {
+	table_ent3(nil,nil,null,pr_void),				/* NULL */
+	table_ent3(GETATTR3res,GETATTR3args,getattr,pr_nfs_fh3),	/* GETATTR */
+	table_ent3(SETATTR3res,SETATTR3args,setattr,pr_nfs_fh3),	/* SETATTR */
+	table_ent3(LOOKUP3res,LOOKUP3args,lookup,pr_diropargs3),	/* LOOKUP */
+	table_ent3(ACCESS3res,ACCESS3args,access,pr_nfs_fh3),		/* ACCESS */
+	table_ent3(READLINK3res,READLINK3args,readlink,pr_nfs_fh3),	/* READLINK */
+	table_ent3(READ3res,READ3args,read,pr_READ3args),		/* READ */
+	table_ent3(WRITE3res,WRITE3args,write,pr_WRITE3args),		/* WRITE */
+	table_ent3(CREATE3res,CREATE3args,create,pr_diropargs3),	/* CREATE */
+	table_ent3(MKDIR3res,MKDIR3args,mkdir,pr_diropargs3),		/* MKDIR */
+	table_ent3(SYMLINK3res,SYMLINK3args,symlink,pr_diropargs3),	/* SYMLINK */
+	table_ent3(MKNOD3res,MKNOD3args,mknod,pr_diropargs3),		/* MKNOD */
+	table_ent3(REMOVE3res,REMOVE3args,remove,pr_diropargs3),	/* REMOVE */
+	table_ent3(RMDIR3res,RMDIR3args,rmdir,pr_diropargs3),		/* RMDIR */
+	table_ent3(RENAME3res,RENAME3args,rename,pr_RENAME3args),	/* RENAME */
+	table_ent3(LINK3res,LINK3args,link,pr_nfs_fh3),			/* LINK */
+	table_ent3(READDIR3res,READDIR3args,readdir,pr_nfs_fh3),	/* READDIR */
+	table_ent3(READDIRPLUS3res,READDIRPLUS3args,readdirplus,pr_nfs_fh3),
+									/* READDIRPLUS */
+	table_ent3(FSSTAT3res,FSSTAT3args,fsstat,pr_nfs_fh3),		/* FSSTAT */
+	table_ent3(FSINFO3res,FSINFO3args,fsinfo,pr_nfs_fh3),		/* FSINFO */
+	table_ent3(PATHCONF3res,PATHCONF3args,pathconf,pr_nfs_fh3),	/* PATHCONF */
+	table_ent3(COMMIT3res,COMMIT3args,commit,pr_nfs_fh3),		/* COMMIT */
+};
+
 #ifdef CALL_PROFILING
 #define PATH_PROFILE	"/tmp/nfsd.profile"
 
@@ -123,7 +164,9 @@ void
 nfs_dispatch(struct svc_req *rqstp, SVCXPRT *transp)
 {
 	unsigned int proc_index = rqstp->rq_proc;
-	struct dispatch_entry *dent;
+	struct dispatch_entry *dent, *table;
+	unsigned int nprocs;
+	int v2 = (rqstp->rq_vers != NFS_V3);
 
 	_rpcsvcdirty = 1;
 
@@ -132,19 +175,36 @@ nfs_dispatch(struct svc_req *rqstp, SVCXPRT *transp)
 	 * to successfully stat() existing file handles */
 	auth_override_uid(ROOT_UID);
 
-	if (proc_index >= (sizeof(dtable) / sizeof(dtable[0]))) {
+	if (v2) {
+		table = dtable;
+		nprocs = sizeof(dtable) / sizeof(dtable[0]);
+	} else {
+		table = dtable3;
+		nprocs = sizeof(dtable3) / sizeof(dtable3[0]);
+	}
+	if (proc_index >= nprocs) {
 		svcerr_noproc(transp);
 		goto done;
 	}
-	dent = &dtable[proc_index];
+	dent = &table[proc_index];
+
+	/* Only version 2 writes are gathered */
+	wg_dispatch(transp, v2 ? (int) proc_index : -1);
 
 #ifdef CALL_PROFILING
-	gettimeofday(&t0, NULL);
+	if (v2)
+		gettimeofday(&t0, NULL);
 #endif
 
 	/* Initialize our variables for determining the attributes of
 	 * the file system in nfsd.c */
 	nfsclient = NULL;
+	auth_clnt_pending = 0;
+
+	/* Don't wait for the name server while serving requests, unless
+	 * the client won't retransmit. Over TCP, it would only do so
+	 * after its full timeout, if at all. */
+	auth_dns_async = (transp == _rpcudpxprt);
 
 	memset(&argument, 0, dent->arg_size);
 	if (!svc_getargs(transp, (xdrproc_t) dent->xdr_argument, (caddr_t) &argument)) {
@@ -163,6 +223,17 @@ nfs_dispatch(struct svc_req *rqstp, SVCXPRT *transp)
 	/* Do the function call itself. */
 	nfs_dispatch_time = time(NULL);
 	result.nfsstat = (*dent->funct) (&argument, rqstp);
+
+	/* If we couldn't tell whether the client may access us because
+	 * its name is still being looked up, have it try again. Version
+	 * 2 clients just retransmit if they get no reply; this only
+	 * happens over UDP. */
+	if (auth_clnt_pending) {
+		if (v2)
+			nfs_reply_deferred = 1;
+		else
+			result.nfsstat = (nfsstat) NFS3ERR_JUKEBOX;
+	}
 	Dprintf(D_CALL, "result: %d\n", result.nfsstat);
 
 #if 0
@@ -170,14 +241,19 @@ nfs_dispatch(struct svc_req *rqstp, SVCXPRT *transp)
 		svcerr_systemerr(transp);
 	}
 #else
-	svc_sendreply(transp, dent->xdr_result, (caddr_t) &result);
+	if (!nfs_reply_deferred)
+		svc_sendreply(transp, dent->xdr_result, (caddr_t) &result);
 #endif
+	iobuf_release();
+	bc_prefetch();
 
 	if (!svc_freeargs(transp, (xdrproc_t) dent->xdr_argument, (caddr_t) &argument)) {
 		Dprintf(L_ERROR, "unable to free RPC arguments, exiting\n");
 		exit(1);
 	}
 #ifdef CALL_PROFILING
+	if (!v2)
+		goto done;
 	gettimeofday(&t1, NULL);
 
 	if (t1.tv_usec < t0.tv_usec) {
@@ -323,3 +399,46 @@ pr_readdirargs(readdirargs *argp)
 	return (fh_pr(&argp->dir));
 }
 
+static char *
+pr_nfs_fh3(nfs_fh3 *argp)
+{
+	if (argp->data.data_len != NFS_FHSIZE)
+		return ("(bad fh)");
+	return (fh_pr((nfs_fh *) argp->data.data_val));
+}
+
+static char *
+pr_diropargs3(diropargs3 *argp)
+{
+	sprintf(printbuf, "fh:%s n:%s", pr_nfs_fh3(&argp->dir), argp->name);
+	return (printbuf);
+}
+
+static char *
+pr_READ3args(READ3args *argp)
+{
+	sprintf(printbuf, "%s: %u bytes at %llu",
+		pr_nfs_fh3(&argp->file), argp->count,
+		(unsigned long long) argp->offset);
+	return (printbuf);
+}
+
+static char *
+pr_WRITE3args(WRITE3args *argp)
+{
+	sprintf(printbuf, "%s: %u bytes at %llu stable %d",
+		pr_nfs_fh3(&argp->file), argp->data.data_len,
+		(unsigned long long) argp->offset, argp->stable);
+	return (printbuf);
+}
+
+static char *
+pr_RENAME3args(RENAME3args *argp)
+{
+	/* fh_pr returns a static buffer, so print one handle at a time */
+	sprintf(printbuf, "fh:%s n:%s -> ",
+		pr_nfs_fh3(&argp->from.dir), argp->from.name);
+	sprintf(printbuf + strlen(printbuf), "fh:%s n:%s",
+		pr_nfs_fh3(&argp->to.dir), argp->to.name);
+	return (printbuf);
+}
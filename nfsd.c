@@ -32,17 +32,6 @@
 
 #define MULTIPLE_SERVERS
 
-/* Flags for auth_fh */
-#define CHK_READ	0
-#define CHK_WRITE	1
-#define CHK_NOACCESS	2
-#define CHK_ROOT	4
-
-/* Make larger reads possible. Without crashing the machine :-) */
-#undef NFS_MAXDATA
-#define NFS_MAXDATA	(16 * 1024)
-
-static char iobuf[NFS_MAXDATA];
 static char pathbuf[NFS_MAXPATHLEN + NFS_MAXNAMLEN + 1];
 static char pathbuf_1[NFS_MAXPATHLEN + NFS_MAXNAMLEN + 1];
 
@@ -64,7 +53,12 @@ static struct option longopts[] = {
       { "promiscuous",		0,			0,	'p' },
       { "re-export",		0,			0,	'r' },
       { "public-root",		required_argument,	0,	'R' },
+      { "readdir-prefetch",	0,			0,	'A' },
       { "synchronous-writes",	0,			0,	's' },
+      { "write-behind",		required_argument,	0,	'W' },
+      { "write-behind-interval",	required_argument,	0,	'I' },
+      { "transfer-size",	required_argument,	0,	'X' },
+      { "block-cache",		required_argument,	0,	'B' },
       { "no-spoof-trace",	0,			0,	't' },
       { "version",		0,			0,	'v' },
       { "no-cross-mounts",	0,			0,	'x' },
@@ -72,13 +66,14 @@ static struct option longopts[] = {
 
       { NULL,		0,	0, 0 }
 };
-static const char *	shortopts = "a:d:Ff:hlnP:prR:tvz::";
+static const char *	shortopts = "a:d:Ff:hlnP:prR:stvz::";
 
 /*
  * Table of supported versions
  */
 static int		nfsd_versions[] = {
 	NFS_VERSION,
+	NFS_V3,
 	0
 };
 
@@ -89,12 +84,9 @@ int			need_flush = 0;		/* flush fh cache */
 int			read_only = 0;		/* Global ro forced */
 int			cross_mounts = 1;	/* Transparently cross mnts */
 int			log_transfers = 0;	/* Log transfers */
+int			nfs_xfersize = NFS_DEF_XFERSIZE; /* max READ/WRITE */
 static svc_fh		public_fh;		/* Public NFSv2 FH */
 
-static nfsstat	build_path(struct svc_req *rqstp, char *buf,
-				diropargs *dopa, int flags);
-static fhcache *auth_fh(struct svc_req *rqstp, nfs_fh *fh, 
-				nfsstat *statp, int flags);
 static void	usage(FILE *, int);
 static void	terminate(void);
 static RETSIGTYPE sigterm(int sig);
@@ -114,11 +106,13 @@ extern void	dump_stats(int sig);
  * It also takes care of caching the client and mount point structures
  * in the fh cache entry, even though this may not be a huge benefit.
  */
-static fhcache *
+fhcache *
 auth_fh(struct svc_req *rqstp, nfs_fh *fh, nfsstat *statp, int flags)
 {
 	static int	total = 0, cached = 0;
 	fhcache		*fhc;
+	fhauth		fa;
+	int		i;
 
 	/* Try to map FH. If not cached, reconstruct path with root priv */
 	fhc = fh_find((svc_fh *)fh, FHFIND_FEXISTS|FHFIND_CHECK);
@@ -127,32 +121,44 @@ auth_fh(struct svc_req *rqstp, nfs_fh *fh, nfsstat *statp, int flags)
 		return NULL;
 	}
 
-	/* Try to retrieve last client who accessed this fh */
+	/* Try to retrieve the client among those who accessed this fh */
 	if (nfsclient == NULL) {
 		struct in_addr	caddr;
 
 		caddr = svc_getcaller(rqstp->rq_xprt)->sin_addr;
-		if (fhc->last_clnt != NULL &&
-		    fhc->last_clnt->clnt_addr.s_addr == caddr.s_addr) {
-			nfsclient = fhc->last_clnt;
+		for (i = 0; i < fhc->nauth; i++) {
+			if (fhc->auth[i].clnt->clnt_addr.s_addr == caddr.s_addr)
+				break;
+		}
+		if (i < fhc->nauth) {
+			nfsclient = fhc->auth[i].clnt;
 		} else if ((nfsclient = auth_clnt(rqstp)) == NULL) {
 			*statp = NFSERR_ACCES;
 			return NULL;
 		}
 	}
 
-	if (fhc->last_clnt == nfsclient) {
-		nfsmount = fhc->last_mount; /* get cached mount point */
+	for (i = 0; i < fhc->nauth; i++) {
+		if (fhc->auth[i].clnt == nfsclient)
+			break;
+	}
+	if (i < fhc->nauth) {
+		fa = fhc->auth[i];	/* get cached mount point */
 		cached++;
 	} else {
-		nfsmount = auth_path(nfsclient, rqstp, fhc->path);
-		if (nfsmount == NULL) {
+		fa.clnt = nfsclient;
+		fa.mount = auth_path(nfsclient, rqstp, fhc->path);
+		if (fa.mount == NULL) {
 			*statp = NFSERR_ACCES;
 			return NULL;
 		}
-		fhc->last_clnt = nfsclient;
-		fhc->last_mount = nfsmount;
+		if (fhc->nauth < FH_AUTH_LIMIT)
+			fhc->nauth++;
+		i = fhc->nauth - 1;
 	}
+	memmove(fhc->auth + 1, fhc->auth, i * sizeof(fhauth));
+	fhc->auth[0] = fa;
+	nfsmount = fa.mount;
 	total++;
 	/*
 	if (total % 1000 == 0)
@@ -183,9 +189,11 @@ auth_fh(struct svc_req *rqstp, nfs_fh *fh, nfsstat *statp, int flags)
 
 /*
  * Build the full path name for a file specified by diropargs.
+ * If dirp is not NULL, the directory's cache entry is returned there.
  */
-static inline nfsstat
-build_path(struct svc_req *rqstp, char *buf, diropargs *dopa, int flags)
+nfsstat
+build_path(struct svc_req *rqstp, char *buf, diropargs *dopa, int flags,
+						fhcache **dirp)
 {
 	fhcache		*fhc;
 	nfsstat		status;
@@ -215,13 +223,15 @@ build_path(struct svc_req *rqstp, char *buf, diropargs *dopa, int flags)
 		return NFSERR_ACCES;
 	auth_user(nfsmount, rqstp);
 
+	if (dirp != NULL)
+		*dirp = fhc;
 	return (NFS_OK);
 }
 
 /*
  * Log a transfer to syslog.
  */
-static void
+void
 nfsd_xferlog(struct svc_req *rqstp, char *inout, char *pathname)
 {
 	struct in_addr	addr = svc_getcaller(rqstp->rq_xprt)->sin_addr;
@@ -229,6 +239,18 @@ nfsd_xferlog(struct svc_req *rqstp, char *inout, char *pathname)
 	syslog(LOG_INFO, "%s %s %s", inet_ntoa(addr), inout, pathname);
 }
 
+/*
+ * The largest READ or WRITE for the transport of this request.
+ * Replies over UDP must fit into a single datagram.
+ */
+int
+nfsd_xfersize(struct svc_req *rqstp)
+{
+	if (rqstp->rq_xprt == _rpcudpxprt && nfs_xfersize > NFS_UDP_MAXXFER)
+		return NFS_UDP_MAXXFER;
+	return nfs_xfersize;
+}
+
 /*
  * The "wrappers" of the following functions came from `rpcgen -l nfs_prot.x`.
  * This normally generates the client routines, but it provides nice
@@ -249,6 +271,7 @@ nfsd_nfsproc_getattr_2(nfs_fh *argp, struct svc_req *rqstp)
 	fhc = auth_fh(rqstp, argp, &status, CHK_READ | CHK_ROOT);
 	if (fhc == NULL)
 		return status;
+	fh_wb_flush(fhc);
 
 	return (fhc_getattr(fhc, &result.attrstat.attrstat_u.attributes,
 						NULL, rqstp));
@@ -265,6 +288,7 @@ nfsd_nfsproc_setattr_2(sattrargs *argp, struct svc_req *rqstp)
 	fhc = auth_fh(rqstp, &(argp->file), &status, CHK_WRITE | CHK_NOACCESS);
 	if (fhc == NULL)
 		return status;
+	fh_wb_flush(fhc);
 	path = fhc->path;
 
 	errno = 0;
@@ -273,6 +297,9 @@ nfsd_nfsproc_setattr_2(sattrargs *argp, struct svc_req *rqstp)
 		goto failure;
 
 	status = setattr(path, &argp->attributes, &buf, rqstp, SATTR_ALL);
+	if (argp->attributes.mode != -1 || argp->attributes.uid != -1
+	 || argp->attributes.gid != -1)
+		fh_perm_flush(fhc);
 	if (status != NFS_OK)
 		return status;
 
@@ -332,6 +359,11 @@ nfsd_nfsproc_lookup_2(diropargs *argp, struct svc_req *rqstp)
 	if (fhc == NULL)
 		return status;
 
+	/* fh_compose doesn't stat the file on a name cache hit, but
+	 * auth_fh has just done so. */
+	if (sbuf.st_nlink == 0 && (fhc->flags & FHC_ATTRVALID))
+		sbuf = fhc->attrs;
+
 	status = fhc_getattr(fhc, &dp->attributes, &sbuf, rqstp);
 	if (status == NFS_OK)
 		Dprintf(D_CALL, "\tnew_fh = %s\n", fh_pr(&(dp->file)));
@@ -360,12 +392,29 @@ nfsd_nfsproc_readlink_2(nfs_fh *argp, struct svc_req *rqstp)
 {
 	nfsstat status;
 	fhcache *fhc;
-	char *path;
-	int cc;
 
 	fhc = auth_fh(rqstp, argp, &status, CHK_READ | CHK_NOACCESS);
 	if (fhc == NULL)
 		return status;
+
+	if ((status = fhc_readlink(fhc, pathbuf)) != NFS_OK)
+		return status;
+	result.readlinkres.readlinkres_u.data = pathbuf;
+	Dprintf(D_CALL, " %s\n", result.readlinkres.readlinkres_u.data);
+	return (NFS_OK);
+}
+
+/*
+ * Read the symlink of an authenticated handle into pathbuf, which must
+ * hold NFS_MAXPATHLEN + 1 bytes. Absolute links are made relative if
+ * the export asks for it.
+ */
+nfsstat
+fhc_readlink(fhcache *fhc, char *pathbuf)
+{
+	char *path;
+	int cc;
+
 	path = fhc->path;
 
 	errno = 0;
@@ -373,9 +422,7 @@ nfsd_nfsproc_readlink_2(nfs_fh *argp, struct svc_req *rqstp)
 		Dprintf(D_CALL, " >>> %s\n", strerror(errno));
 		return (nfs_errno());
 	}
-	status = NFS_OK;
 	pathbuf[cc] = '\0';	/* readlink() doesn't null terminate!! */
-	result.readlinkres.readlinkres_u.data = pathbuf;
 
 	if (nfsmount->o.link_relative && pathbuf[0] == '/') {
 		/*
@@ -426,7 +473,6 @@ nfsd_nfsproc_readlink_2(nfs_fh *argp, struct svc_req *rqstp)
 			}
 		}
 	}
-	Dprintf(D_CALL, " %s\n", result.readlinkres.readlinkres_u.data);
 	return (NFS_OK);
 }
 
@@ -436,23 +482,28 @@ nfsd_nfsproc_read_2(readargs *argp, struct svc_req *rqstp)
 	nfsstat status;
 	fhcache *fhc;
 	readokres *res = &result.readres.readres_u.reply;
+	char	*buf;
 	int	fd, len;
 
 	fhc = auth_fh(rqstp, &(argp->file), &status, CHK_READ | CHK_NOACCESS);
 	if (fhc == NULL)
 		return status;
+	fh_wb_flush(fhc);
 
 	if ((fd = fh_fd(fhc, &status, O_RDONLY)) < 0)
 		return ((int) status);
 
-	len = -1;
-	if (efs_lseek(fd, (long) argp->offset, L_SET) >= 0) {
-		res->data.data_val = iobuf;
-		if ((len = argp->count) > NFS_MAXDATA)
-			len = NFS_MAXDATA;
-		if ((len = efs_read(fd, iobuf, len)) >= 0)
-			res->data.data_len = len;
+	if ((len = argp->count) > NFS_MAXDATA)
+		len = NFS_MAXDATA;
+	if (len > nfsd_xfersize(rqstp))
+		len = nfsd_xfersize(rqstp);
+	if ((buf = iobuf_get(len)) == NULL) {
+		fd_inactive(fd);
+		return (NFSERR_IO);
 	}
+	res->data.data_val = buf;
+	if ((len = bc_read(fhc, fd, buf, len, (off_t) argp->offset)) >= 0)
+		res->data.data_len = len;
 	fd_inactive(fd);
 	if (len < 0)
 		return (nfs_errno());
@@ -461,7 +512,11 @@ nfsd_nfsproc_read_2(readargs *argp, struct svc_req *rqstp)
 	if (argp->offset == 0 && log_transfers)
 		nfsd_xferlog(rqstp, "<", fhc->path);
 
-	return (fhc_getattr(fhc, &(res->attributes), NULL, rqstp));
+	/* Reading doesn't change anything but atime, so the attributes
+	 * auth_fh has just fetched are good enough for the reply. */
+	return (fhc_getattr(fhc, &(res->attributes),
+			(fhc->flags & FHC_ATTRVALID) ? &fhc->attrs : NULL,
+			rqstp));
 }
 
 int
@@ -492,22 +547,50 @@ nfsd_nfsproc_write_2(writeargs *argp, struct svc_req *rqstp)
 	if ((fd = fh_fd(fhc, &status, O_WRONLY)) < 0)
 		return ((int) status);
 
-	len = -1;
-	if (efs_lseek(fd, (long) argp->offset, L_SET) >= 0) {
-		len = efs_write(fd, argp->data.data_val, argp->data.data_len);
-		if (len != argp->data.data_len)
-			Dprintf(D_CALL, "Write failure, errno is %d.\n", errno);
-	}
-	fd_inactive(fd);
-	if (len < 0)
+	/* On async exports, leave the data in the write-behind buffer.
+	 * Otherwise, make sure no buffered data overwrites it later;
+	 * if that fails, the error goes to the next COMMIT. */
+	len = 0;
+	if (nfsmount->o.async && fh_wb_max > 0)
+		len = fh_wb_write(fhc, fd, argp->data.data_val,
+				argp->data.data_len, (off_t) argp->offset);
+	else
+		fh_wb_flush(fhc);
+	if (len > 0)
+		len = argp->data.data_len;
+	else
+		len = efs_pwrite(fd, argp->data.data_val, argp->data.data_len,
+						(off_t) argp->offset);
+	if (len != argp->data.data_len)
+		Dprintf(D_CALL, "Write failure, errno is %d.\n", errno);
+	if (len < 0) {
+		fd_inactive(fd);
 		return nfs_errno();
+	}
+	fh_io_hint(fhc, fd, (off_t) argp->offset, len, 1);
+
+	/* Get the post-op attributes from the open file rather than
+	 * looking up the path again. */
+	fhc->flags &= ~FHC_ATTRVALID;
+	if (efs_fstat(fd, &fhc->attrs) >= 0)
+		fhc->flags |= FHC_ATTRVALID;
 
 	/* Write record to syslog */
 	if (argp->offset == 0 && log_transfers)
 		nfsd_xferlog(rqstp, ">", fhc->path);
 
-	return (fhc_getattr(fhc, &(result.attrstat.attrstat_u.attributes),
-							NULL, rqstp));
+	status = fhc_getattr(fhc, &(result.attrstat.attrstat_u.attributes),
+			(fhc->flags & FHC_ATTRVALID) ? &fhc->attrs : NULL,
+			rqstp);
+	if (status == NFS_OK && !nfsmount->o.async) {
+		/* Commit the data, or hold back the reply until a
+		 * batch of WRITEs is committed. */
+		result.attrstat.status = NFS_OK;
+		wg_commit(rqstp, fhc, fd, &result.attrstat);
+		status = result.attrstat.status;
+	}
+	fd_inactive(fd);
+	return ((int) status);
 }
 
 /* This used to be O_RDWR, but O_WRONLY is correct */
@@ -534,7 +617,7 @@ nfsd_nfsproc_create_2(createargs *argp, struct svc_req *rqstp)
 	 * clients succeed on RO-filesystems.
 	 */
 	status = build_path(rqstp, pathbuf, &argp->where,
-					CHK_WRITE | CHK_NOACCESS);
+					CHK_WRITE | CHK_NOACCESS, NULL);
 	if (status != NFS_OK && status != NFSERR_ROFS)
 		return ((int) status);
 	Dprintf(D_CALL, "\tfullpath='%s'\n", pathbuf);
@@ -631,6 +714,8 @@ nfsd_nfsproc_create_2(createargs *argp, struct svc_req *rqstp)
 			CREATE_OMODE | O_TRUNC : CREATE_OMODE);
 		if (!exists)
 			flags |= O_CREAT;
+		else
+			fh_wb_flush_path(pathbuf);
 		tmpfd = path_open(pathbuf, flags, 
 				argp->attributes.mode & ~S_IFMT);
 		if (tmpfd < 0)
@@ -656,6 +741,9 @@ nfsd_nfsproc_create_2(createargs *argp, struct svc_req *rqstp)
 	if (status != NFS_OK)
 		return status;
 
+	if (!exists)
+		fh_dir_modified(pathbuf);
+
 	res = &result.diropres.diropres_u.diropres;
 	status = fh_compose(&argp->where, &res->file, &sbuf,
 			    tmpfd, CREATE_OMODE, 0);
@@ -683,7 +771,8 @@ nfsd_nfsproc_remove_2(diropargs *argp, struct svc_req *rqstp)
 {
 	nfsstat status;
 
-	status = build_path(rqstp, pathbuf, argp, CHK_WRITE | CHK_NOACCESS);
+	status = build_path(rqstp, pathbuf, argp,
+					CHK_WRITE | CHK_NOACCESS, NULL);
 	if (status != NFS_OK)
 		return ((int) status);
 
@@ -691,6 +780,7 @@ nfsd_nfsproc_remove_2(diropargs *argp, struct svc_req *rqstp)
 
 	/* Remove the file handle from our cache. */
 	fh_remove(pathbuf);
+	fh_dir_modified(pathbuf);
 
 	if (efs_unlink(pathbuf) != 0)
 		return (nfs_errno());
@@ -703,22 +793,28 @@ nfsd_nfsproc_rename_2(renameargs *argp, struct svc_req *rqstp)
 {
 	nfsstat status;
 
-	status = build_path(rqstp, pathbuf, &argp->from, CHK_WRITE | CHK_NOACCESS);
+	status = build_path(rqstp, pathbuf, &argp->from,
+					CHK_WRITE | CHK_NOACCESS, NULL);
 	if (status != NFS_OK)
 		return ((int) status);
-	status = build_path(rqstp, pathbuf_1, &argp->to, CHK_WRITE | CHK_NOACCESS);
+	status = build_path(rqstp, pathbuf_1, &argp->to,
+					CHK_WRITE | CHK_NOACCESS, NULL);
 	if (status != NFS_OK)
 		return ((int) status);
 
 	Dprintf(D_CALL, "\tpathfrom='%s' pathto='%s'\n", pathbuf, pathbuf_1);
 
-	/* Remove any file handle from our cache. */
-	fh_remove(pathbuf);
+	/* Remove the handle of the file being replaced from our cache. */
 	fh_remove(pathbuf_1);
+	fh_dir_modified(pathbuf);
+	fh_dir_modified(pathbuf_1);
 
 	if (efs_rename(pathbuf, pathbuf_1) != 0)
 		return (nfs_errno());
 
+	/* Cached handles below the old name move along with it. */
+	fh_rename(pathbuf, pathbuf_1);
+
 	return (NFS_OK);
 }
 
@@ -740,7 +836,8 @@ nfsd_nfsproc_link_2(linkargs *argp, struct svc_req *rqstp)
 	mountp1 = nfsmount;
 	path = fhc->path;
 
-	status = build_path(rqstp, pathbuf_1, &argp->to, CHK_WRITE | CHK_NOACCESS);
+	status = build_path(rqstp, pathbuf_1, &argp->to,
+					CHK_WRITE | CHK_NOACCESS, NULL);
 	if (status != NFS_OK)
 		return ((int) status);
 
@@ -753,6 +850,7 @@ nfsd_nfsproc_link_2(linkargs *argp, struct svc_req *rqstp)
 
 	if (efs_link(path, pathbuf_1) != 0)
 		return (nfs_errno());
+	fh_dir_modified(pathbuf_1);
 	return (NFS_OK);
 }
 
@@ -761,7 +859,8 @@ nfsd_nfsproc_symlink_2(symlinkargs *argp, struct svc_req *rqstp)
 {
 	nfsstat status;
 
-	status = build_path(rqstp, pathbuf, &argp->from, CHK_WRITE | CHK_NOACCESS);
+	status = build_path(rqstp, pathbuf, &argp->from,
+					CHK_WRITE | CHK_NOACCESS, NULL);
 	if (status != NFS_OK)
 		return ((int) status);
 
@@ -769,6 +868,7 @@ nfsd_nfsproc_symlink_2(symlinkargs *argp, struct svc_req *rqstp)
 
 	if (efs_symlink(argp->to, pathbuf) != 0)
 		return (nfs_errno());
+	fh_dir_modified(pathbuf);
 
 	/*
          * NFS version 2 documentation says "On UNIX servers the
@@ -791,7 +891,8 @@ nfsd_nfsproc_mkdir_2(createargs *argp, struct svc_req *rqstp)
 	struct stat sbuf;
 	diropokres *res;
 
-	status = build_path(rqstp, pathbuf, &argp->where, CHK_WRITE | CHK_NOACCESS);
+	status = build_path(rqstp, pathbuf, &argp->where,
+					CHK_WRITE | CHK_NOACCESS, NULL);
 	if (status != NFS_OK)
 		return ((int) status);
 
@@ -799,6 +900,7 @@ nfsd_nfsproc_mkdir_2(createargs *argp, struct svc_req *rqstp)
 
 	if (efs_mkdir(pathbuf, argp->attributes.mode) != 0)
 		return (nfs_errno());
+	fh_dir_modified(pathbuf);
 
 	res = &result.diropres.diropres_u.diropres;
 	status = fh_compose(&(argp->where), &(res->file), &sbuf, -1, -1, 0);
@@ -827,7 +929,8 @@ nfsd_nfsproc_rmdir_2(diropargs *argp, struct svc_req *rqstp)
 {
 	nfsstat status;
 
-	status = build_path(rqstp, pathbuf, argp, CHK_WRITE | CHK_NOACCESS);
+	status = build_path(rqstp, pathbuf, argp,
+					CHK_WRITE | CHK_NOACCESS, NULL);
 	if (status != NFS_OK)
 		return ((int) status);
 
@@ -835,6 +938,7 @@ nfsd_nfsproc_rmdir_2(diropargs *argp, struct svc_req *rqstp)
 
 	/* Remove that file handle from our cache. */
 	fh_remove(pathbuf);
+	fh_dir_modified(pathbuf);
 
 	if (rmdir(pathbuf) != 0)
 		return (nfs_errno());
@@ -860,7 +964,7 @@ nfsd_nfsproc_readdir_2(readdirargs *argp, struct svc_req *rqstp)
 	DIR		*dirp;
 	struct dirent	*dp;
 	struct stat	sbuf;
-	int		res_size, dotsonly, hidedot, first;
+	int		res_size, dotsonly, hidedot, first, nprefetch;
 	fhcache		*h;
 	nfsstat		status;
 	ino_t		dotinum = 0;
@@ -902,6 +1006,7 @@ nfsd_nfsproc_readdir_2(readdirargs *argp, struct svc_req *rqstp)
 		efs_seekdir(dirp, ntohl(dloc));
 
 	first = 1;
+	nprefetch = 0;
 	ep = &(result.readdirres.readdirres_u.reply.entries);
 	while ((dp = efs_readdir(dirp)) != NULL) {
 		res_size += dpsize(dp);
@@ -923,6 +1028,9 @@ nfsd_nfsproc_readdir_2(readdirargs *argp, struct svc_req *rqstp)
 		e->fileid = pseudo_inode(dp->d_ino, sbuf.st_dev);
 		e->name = xmalloc(NLENGTH(dp) + 1);
 		strcpy(e->name, dp->d_name);
+		if (fh_prefetch && !dotsonly && nprefetch++ < PREFETCH_MAX)
+			fh_prefetch_entry(h, dirfd(dirp), dp->d_name,
+						dp->d_ino, sbuf.st_dev);
 		dloc = htonl(efs_telldir(dirp));
 		memcpy(&e->cookie, &dloc, sizeof(nfscookie));
 		ep = &e->nextentry;
@@ -957,7 +1065,8 @@ nfsd_nfsproc_statfs_2(nfs_fh *argp, struct svc_req *rqstp)
 	if (get_fs_usage(path, NULL, &fs) < 0)
 		return (nfs_errno());
 	result.statfsres.status = NFS_OK;
-	result.statfsres.statfsres_u.reply.tsize = 8*1024;
+	result.statfsres.statfsres_u.reply.tsize =
+				MIN(nfsd_xfersize(rqstp), NFS_MAXDATA);
 	result.statfsres.statfsres_u.reply.bsize = 512;
 	result.statfsres.statfsres_u.reply.blocks = fs.fsu_blocks;
 	result.statfsres.statfsres_u.reply.bfree = fs.fsu_bfree;
@@ -1023,6 +1132,46 @@ main(int argc, char **argv)
 		case 'R':
 			public_root_path = xstrdup(optarg);
 			break;
+		case 'A':
+			fh_prefetch = 1;
+			break;
+		case 's':
+			sync_writes = 1;
+			break;
+		case 'W':
+			fh_wb_max = atoi(optarg) * 1024;
+			if (fh_wb_max < 0 || (fh_wb_max && fh_wb_max < WB_BUFSIZE)) {
+				fprintf(stderr, "nfsd: write-behind size must "
+					"be 0 or at least %d kbytes\n",
+					WB_BUFSIZE / 1024);
+				usage(stderr, 1);
+			}
+			break;
+		case 'I':
+			fh_wb_interval = atoi(optarg);
+			if (fh_wb_interval <= 0) {
+				fprintf(stderr, "nfsd: bad write-behind "
+					"interval: %s\n", optarg);
+				usage(stderr, 1);
+			}
+			break;
+		case 'X':
+			nfs_xfersize = atoi(optarg) * 1024;
+			if (nfs_xfersize < 4096 || nfs_xfersize > NFS_MAXXFER) {
+				fprintf(stderr, "nfsd: transfer size must be "
+					"between 4 and %d kbytes\n",
+					NFS_MAXXFER / 1024);
+				usage(stderr, 1);
+			}
+			break;
+		case 'B':
+			if ((bc_max = atoi(optarg)) < 0) {
+				fprintf(stderr, "nfsd: bad block cache size: "
+					"%s\n", optarg);
+				usage(stderr, 1);
+			}
+			bc_max /= 8;	/* 8K blocks */
+			break;
 		case 't':
 			trace_spoof = 0;
 			break;
@@ -1080,9 +1229,11 @@ main(int argc, char **argv)
 	/* Initialize logging. */
 	log_open("nfsd", foreground);
 
-	/* Initialize RPC stuff */
+	/* Initialize RPC stuff. Socket buffers are sized from the transfer
+	 * size, but never smaller than for the old fixed 16K limit, so that
+	 * clients can still have plenty of small requests in flight. */
 	rpc_init("nfsd", NFS_PROGRAM, nfsd_versions, nfs_dispatch,
-				nfsport, NFS_MAXDATA);
+				nfsport, MAX(nfs_xfersize, 2 * NFS_MAXDATA));
 
 	/* No more than 1 copy when run from inetd */
 	if (_rpcpmstart && ncopies > 1) {
@@ -1097,6 +1248,12 @@ main(int argc, char **argv)
 		read_only = 1;
 #endif
 
+	/* Gathered writes rely on us seeing all requests on the socket */
+	wg_init(ncopies == 1);
+
+	/* All server processes must share the NFSv3 write verifier */
+	nfs3_init();
+
 	/* We first fork off a child. */
 	if (!foreground) {
 		if ((c = fork()) > 0)
@@ -1202,6 +1359,9 @@ usage(FILE *fp, int n)
 "       [--debug kind] [--exports-file=file] [--port port]\n"
 "       [--allow-non-root] [--promiscuous] [--version] [--foreground]\n"
 "       [--re-export] [--log-transfers] [--public-root path]\n"
+"       [--readdir-prefetch] [--synchronous-writes]\n"
+"       [--write-behind kbytes] [--write-behind-interval secs]\n"
+"       [--transfer-size kbytes] [--block-cache kbytes]\n"
 "       [--no-spoof-trace] [--help]\n"
 						, program_name);
 	exit(n);
@@ -1219,6 +1379,7 @@ sigterm(int sig)
 static void
 terminate(void)
 {
+	fh_wb_sync(1);
 	rpc_exit(NFS_PROGRAM, nfsd_versions);
 	efs_shutdown();
 }
@@ -1234,8 +1395,7 @@ RETSIGTYPE reinitialize(sig)
 	if (inprogress++)	/* Probably non-atomic. Yuck */
 		return;
 	auth_override_uid(0);	/* May need root privs to read exports */
-	fh_flush(1);
-	auth_init(NULL);	/* auth_init saves the exports file name */
+	fh_reload_exports();
 	inprogress = 0;
 	need_reinit = 0;
 }
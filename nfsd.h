@@ -15,6 +15,7 @@
 
 #include "mount.h"
 #include "nfs_prot.h"
+#include "nfs3_prot.h"
 #include "extensions.h"
 
 union argument_types {
@@ -33,6 +34,27 @@ union argument_types {
 	diropargs		nfsproc_rmdir_2_arg;
 	readdirargs		nfsproc_readdir_2_arg;
 	nfs_fh			nfsproc_statfs_2_arg;
+	GETATTR3args		nfsproc3_getattr_3_arg;
+	SETATTR3args		nfsproc3_setattr_3_arg;
+	LOOKUP3args		nfsproc3_lookup_3_arg;
+	ACCESS3args		nfsproc3_access_3_arg;
+	READLINK3args		nfsproc3_readlink_3_arg;
+	READ3args		nfsproc3_read_3_arg;
+	WRITE3args		nfsproc3_write_3_arg;
+	CREATE3args		nfsproc3_create_3_arg;
+	MKDIR3args		nfsproc3_mkdir_3_arg;
+	SYMLINK3args		nfsproc3_symlink_3_arg;
+	MKNOD3args		nfsproc3_mknod_3_arg;
+	REMOVE3args		nfsproc3_remove_3_arg;
+	RMDIR3args		nfsproc3_rmdir_3_arg;
+	RENAME3args		nfsproc3_rename_3_arg;
+	LINK3args		nfsproc3_link_3_arg;
+	READDIR3args		nfsproc3_readdir_3_arg;
+	READDIRPLUS3args	nfsproc3_readdirplus_3_arg;
+	FSSTAT3args		nfsproc3_fsstat_3_arg;
+	FSINFO3args		nfsproc3_fsinfo_3_arg;
+	PATHCONF3args		nfsproc3_pathconf_3_arg;
+	COMMIT3args		nfsproc3_commit_3_arg;
 };
 
 union result_types {
@@ -43,6 +65,27 @@ union result_types {
 	nfsstat			nfsstat;
 	readdirres		readdirres;
 	statfsres		statfsres;
+	GETATTR3res		getattr3res;
+	SETATTR3res		setattr3res;
+	LOOKUP3res		lookup3res;
+	ACCESS3res		access3res;
+	READLINK3res		readlink3res;
+	READ3res		read3res;
+	WRITE3res		write3res;
+	CREATE3res		create3res;
+	MKDIR3res		mkdir3res;
+	SYMLINK3res		symlink3res;
+	MKNOD3res		mknod3res;
+	REMOVE3res		remove3res;
+	RMDIR3res		rmdir3res;
+	RENAME3res		rename3res;
+	LINK3res		link3res;
+	READDIR3res		readdir3res;
+	READDIRPLUS3res		readdirplus3res;
+	FSSTAT3res		fsstat3res;
+	FSINFO3res		fsinfo3res;
+	PATHCONF3res		pathconf3res;
+	COMMIT3res		commit3res;
 };
 
 /* Global variables. */
@@ -51,6 +94,21 @@ extern union result_types	result;
 extern int			need_reinit;
 extern int			need_flush;
 extern time_t			nfs_dispatch_time;
+extern int			sync_writes;
+extern int			nfs_reply_deferred;
+extern int			read_only;
+extern int			log_transfers;
+extern int			nfs_xfersize;
+extern int			bc_max;
+
+/* Limits for the size of READs and WRITEs. Version 2 has its own
+ * limit of NFS_MAXDATA, which is less than all of these. */
+#define NFS_MAXXFER		(64 * 1024)
+#define NFS_UDP_MAXXFER		(32 * 1024)
+#define NFS_DEF_XFERSIZE	(32 * 1024)
+
+/* Default size of the READ block cache */
+#define BC_DEFAULT_SIZE		(4 * 1024 * 1024)
 
 /* Include the other module definitions. */
 #include "auth.h"
@@ -72,8 +130,50 @@ extern nfsstat	fh_setattr(nfs_fh *fh, sattr *attr,
 extern nfsstat	setattr(char *path, sattr *attr,
 					struct stat *stat_optimize,
 					struct svc_req *, int flags);
+extern nfsstat	fhc_getattr3(fhcache *fhc, fattr3 *attr,
+					struct stat *stat_optimize,
+					struct svc_req *rqstp);
+extern nfsstat	setattr3(char *path, sattr3 *attr,
+					struct stat *stat_optimize,
+					struct svc_req *, int flags);
 extern RETSIGTYPE reinitialize(int sig);
 
+/* Flags for auth_fh */
+#define CHK_READ	0
+#define CHK_WRITE	1
+#define CHK_NOACCESS	2
+#define CHK_ROOT	4
+
+/* nfsd.c */
+extern fhcache	*auth_fh(struct svc_req *rqstp, nfs_fh *fh,
+					nfsstat *statp, int flags);
+extern nfsstat	build_path(struct svc_req *rqstp, char *buf,
+					diropargs *dopa, int flags,
+					fhcache **dirp);
+extern nfsstat	fhc_readlink(fhcache *fhc, char *pathbuf);
+extern void	nfsd_xferlog(struct svc_req *rqstp, char *inout,
+					char *pathname);
+extern int	nfsd_xfersize(struct svc_req *rqstp);
+
+/* iobuf.c */
+extern char *	iobuf_get(size_t size);
+extern void	iobuf_release(void);
+
+/* bcache.c */
+extern int	bc_read(fhcache *fhc, int fd, char *buf, size_t len,
+					off_t offset);
+extern void	bc_prefetch(void);
+
+/* nfs3.c */
+extern void	nfs3_init(void);
+
+/* wgather.c */
+extern void	wg_init(int gather);
+extern void	wg_dispatch(SVCXPRT *xprt, int proc);
+extern void	wg_commit(struct svc_req *rqstp, fhcache *fhc, int fd,
+					attrstat *res);
+extern void	wg_flush(void);
+
 #define SATTR_STAT		0x01
 #define SATTR_CHOWN		0x02
 #define SATTR_CHMOD		0x04
@@ -108,4 +208,27 @@ extern int nfsd_nfsproc_rmdir_2(diropargs *, struct svc_req *);
 extern int nfsd_nfsproc_readdir_2(readdirargs *, struct svc_req *);
 extern int nfsd_nfsproc_statfs_2(nfs_fh *, struct svc_req *);
 
+extern int nfsd_nfsproc3_null_3(void *, struct svc_req *);
+extern int nfsd_nfsproc3_getattr_3(GETATTR3args *, struct svc_req *);
+extern int nfsd_nfsproc3_setattr_3(SETATTR3args *, struct svc_req *);
+extern int nfsd_nfsproc3_lookup_3(LOOKUP3args *, struct svc_req *);
+extern int nfsd_nfsproc3_access_3(ACCESS3args *, struct svc_req *);
+extern int nfsd_nfsproc3_readlink_3(READLINK3args *, struct svc_req *);
+extern int nfsd_nfsproc3_read_3(READ3args *, struct svc_req *);
+extern int nfsd_nfsproc3_write_3(WRITE3args *, struct svc_req *);
+extern int nfsd_nfsproc3_create_3(CREATE3args *, struct svc_req *);
+extern int nfsd_nfsproc3_mkdir_3(MKDIR3args *, struct svc_req *);
+extern int nfsd_nfsproc3_symlink_3(SYMLINK3args *, struct svc_req *);
+extern int nfsd_nfsproc3_mknod_3(MKNOD3args *, struct svc_req *);
+extern int nfsd_nfsproc3_remove_3(REMOVE3args *, struct svc_req *);
+extern int nfsd_nfsproc3_rmdir_3(RMDIR3args *, struct svc_req *);
+extern int nfsd_nfsproc3_rename_3(RENAME3args *, struct svc_req *);
+extern int nfsd_nfsproc3_link_3(LINK3args *, struct svc_req *);
+extern int nfsd_nfsproc3_readdir_3(READDIR3args *, struct svc_req *);
+extern int nfsd_nfsproc3_readdirplus_3(READDIRPLUS3args *, struct svc_req *);
+extern int nfsd_nfsproc3_fsstat_3(FSSTAT3args *, struct svc_req *);
+extern int nfsd_nfsproc3_fsinfo_3(FSINFO3args *, struct svc_req *);
+extern int nfsd_nfsproc3_pathconf_3(PATHCONF3args *, struct svc_req *);
+extern int nfsd_nfsproc3_commit_3(COMMIT3args *, struct svc_req *);
+
 /* End of nfsd.h. */
@@ -34,11 +34,13 @@ extern SVCXPRT *svcfd_create(int sock, u_int ssize, u_int rsize);
 static int	makesock(int port, int proto, int socksz);
 
 #define _RPCSVC_CLOSEDOWN	120
+#define UDP_MAXMSG		65507	/* largest UDP payload */
 time_t		closedown = 0;
 int		_rpcpmstart = 0;
 int		_rpcfdtype = 0;
 int		_rpcsvcdirty = 0;
 const char *	auth_daemon = 0;
+SVCXPRT *	_rpcudpxprt = NULL;	/* our UDP transport, if any */
 
 #ifdef AUTH_DAEMON
 static bool_t	(*tcp_rendevouser)(SVCXPRT *, struct rpc_msg *);
@@ -84,9 +86,16 @@ not_inetd:
 	if ((_rpcfdtype == 0) || (_rpcfdtype == SOCK_DGRAM)) {
 		if (_rpcpmstart == 0 && defport != 0)
 	    		sock = makesock(defport, IPPROTO_UDP, bufsiz);
-		transp = svcudp_create(sock);
+		/* 1024 for rpc overhead, like in makesock */
+		if (bufsiz != 0)
+			transp = svcudp_bufcreate(sock,
+					MIN(bufsiz + 1024, UDP_MAXMSG),
+					MIN(bufsiz + 1024, UDP_MAXMSG));
+		else
+			transp = svcudp_create(sock);
 		if (transp == NULL)
 			Dprintf(L_FATAL, "cannot create udp service.");
+		_rpcudpxprt = transp;
 		for (i = 0; (vers = verstbl[i]) != 0; i++) {
 			if (!svc_register(transp, prog, vers, dispatch, IPPROTO_UDP)) {
 				Dprintf(L_FATAL,
@@ -99,7 +108,8 @@ not_inetd:
 	if ((_rpcfdtype == 0) || (_rpcfdtype == SOCK_STREAM)) {
 		if (_rpcpmstart == 0 && defport != 0)
 			sock = makesock(defport, IPPROTO_TCP, bufsiz);
-		transp = svctcp_create(sock, 0, 0);
+		transp = svctcp_create(sock, bufsiz ? bufsiz + 1024 : 0,
+					     bufsiz ? bufsiz + 1024 : 0);
 		if (transp == NULL)
 			Dprintf(L_FATAL, "cannot create tcp service.");
 #ifdef AUTH_DAEMON
@@ -156,6 +166,8 @@ rpc_closedown(void)
 		 * connected */
 		if (size == 0) {
 			size = getdtablesize();
+			if (size > FD_SETSIZE)
+				size = FD_SETSIZE;
 		}
 		for (i = 0; i < size; i++) {
 			if (!FD_ISSET(i, &svc_fdset))
@@ -10,6 +10,7 @@ extern int		_rpcpmstart;
 extern int		_rpcfdtype;
 extern int		_rpcsvcdirty;
 extern const char *	auth_daemon;
+extern SVCXPRT *	_rpcudpxprt;
 
 extern void		rpc_init(const char *name, int prog, int *verstbl,
 					void (*dispatch)(),
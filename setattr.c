@@ -136,3 +136,112 @@ nfsstat setattr(char *path, sattr *attr, struct stat *s,
 failure:
 	return nfs_errno();
 }
+
+/*
+ * Set NFSv3 file attributes given the path. This works like setattr(),
+ * except that every attribute comes with a flag telling whether to set
+ * it, and times may be set to the server's clock.
+ */
+nfsstat
+setattr3(char *path, sattr3 *attr, struct stat *s,
+			struct svc_req *rqstp, int flags)
+{
+	struct stat	sbuf;
+
+	if (s == NULL) {
+		s = &sbuf;
+		flags |= SATTR_STAT;
+	}
+
+	if ((flags & SATTR_STAT) && efs_lstat(path, (s = &sbuf)) < 0) {
+		Dprintf(D_CALL, "setattr3: couldn't stat %s! errno=%d\n",
+				path, errno);
+		return nfs_errno();
+	}
+
+	if ((flags & SATTR_SIZE) && attr->size.set_it) {
+		off_t		size = attr->size.set_size3_u.size;
+
+		if (size < 0 || size != attr->size.set_size3_u.size)
+			return NFSERR_FBIG;
+		if (!S_ISREG(s->st_mode))
+			return NFSERR_INVAL;
+		if (truncate(path, size) < 0)
+			goto failure;
+		s->st_size = size;
+	}
+
+	if ((flags & SATTR_UTIMES)
+	 && (attr->atime.set_it != DONT_CHANGE
+	  || attr->mtime.set_it != DONT_CHANGE)) {
+		struct timeval	tvp[2];
+		nfstime3	*tp;
+		int		res;
+
+		if (attr->atime.set_it == SET_TO_SERVER_TIME
+		 && attr->mtime.set_it == SET_TO_SERVER_TIME) {
+			/* This is allowed with mere write permission */
+			res = efs_utimes(path, NULL);
+			s->st_atime = s->st_mtime = time(NULL);
+		} else {
+			gettimeofday(&tvp[0], NULL);
+			tvp[1] = tvp[0];
+			if (attr->atime.set_it == SET_TO_CLIENT_TIME) {
+				tp = &attr->atime.set_atime_u.atime;
+				tvp[0].tv_sec  = tp->seconds;
+				tvp[0].tv_usec = tp->nseconds / 1000;
+			} else if (attr->atime.set_it == DONT_CHANGE) {
+				tvp[0].tv_sec  = s->st_atime;
+				tvp[0].tv_usec = 0;
+			}
+			if (attr->mtime.set_it == SET_TO_CLIENT_TIME) {
+				tp = &attr->mtime.set_mtime_u.mtime;
+				tvp[1].tv_sec  = tp->seconds;
+				tvp[1].tv_usec = tp->nseconds / 1000;
+			} else if (attr->mtime.set_it == DONT_CHANGE) {
+				tvp[1].tv_sec  = s->st_mtime;
+				tvp[1].tv_usec = 0;
+			}
+			res = efs_utimes(path, tvp);
+			s->st_atime = tvp[0].tv_sec;
+			s->st_mtime = tvp[1].tv_sec;
+		}
+		if (res < 0 && (errno != ENOENT || lstat(path, &sbuf)))
+			goto failure;
+	}
+
+	if ((flags & SATTR_CHMOD) && attr->mode.set_it) {
+		unsigned int	mode = attr->mode.set_mode3_u.mode;
+
+		if ((mode & 07777) != (s->st_mode & 07777)) {
+			if (efs_chmod(path, mode & 07777) < 0
+				&& (errno != ENOENT || lstat(path, &sbuf)))
+				goto failure;
+			s->st_mode = (s->st_mode & ~07777) | (mode & 07777);
+		}
+	}
+
+	if ((flags & SATTR_CHOWN)
+	 && (attr->uid.set_it || attr->gid.set_it)) {
+		uid_t		uid = (uid_t) -1;
+		gid_t		gid = (gid_t) -1;
+
+		if (attr->uid.set_it)
+			uid = luid(attr->uid.set_uid3_u.uid, nfsmount, rqstp);
+		if (attr->gid.set_it)
+			gid = lgid(attr->gid.set_gid3_u.gid, nfsmount, rqstp);
+
+		if ((uid != (uid_t)-1 && uid != s->st_uid)
+		 || (gid != (gid_t)-1 && gid != s->st_gid)) {
+			if (efs_lchown(path, uid, gid) < 0)
+				goto failure;
+			if (uid != (uid_t)-1) s->st_uid = uid;
+			if (gid != (gid_t)-1) s->st_gid = gid;
+		}
+	}
+
+	return (NFS_OK);
+
+failure:
+	return nfs_errno();
+}
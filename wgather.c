@@ -0,0 +1,260 @@
+/*
+ * wgather.c	Write gathering for synchronous writes.
+ *
+ *		With --synchronous-writes, every WRITE has to be on disk
+ *		before we reply. Committing each 8K write separately is
+ *		very slow, and clients usually have several WRITEs to the
+ *		same file in flight. So when a WRITE has been done and the
+ *		next request is already waiting on the socket, we hold
+ *		back the reply instead of committing. As long as the
+ *		following requests are WRITEs to the same file, they are
+ *		added to the batch. One fdatasync() then covers the lot,
+ *		after which all held back replies go out.
+ *
+ *		The batch is committed as soon as any other request comes
+ *		in, when there is no more input, or when it is full. Only
+ *		UDP requests are gathered; on TCP each WRITE is committed
+ *		by itself.
+ *
+ *		Since the RPC library sends replies only for the request
+ *		it is currently working on, we remember the xid of each
+ *		incoming UDP call and build held back replies ourselves.
+ */
+
+#include "nfsd.h"
+#include <sys/poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#define WG_MAX		16		/* max # of held back replies	*/
+#define WG_WAIT		2		/* msecs to wait for next WRITE	*/
+
+typedef struct wg_reply {
+	SVCXPRT *		xprt;
+	u_int32_t		xid;
+	struct sockaddr_in	addr;
+	attrstat		res;
+} wg_reply;
+
+int			sync_writes = 0;
+int			nfs_reply_deferred = 0;
+
+static int		wg_enabled = 0;
+static wg_reply		wg_replies[WG_MAX];
+static int		wg_count = 0;
+static int		wg_fd = -1;		/* dup'ed fd of batched file */
+static psi_t		wg_psi;
+static int		wg_wait = WG_WAIT;
+
+/* The UDP transport with our receive hook */
+static struct xp_ops	wg_udp_ops;
+static const void *	wg_other_ops = NULL;
+static bool_t		(*wg_udp_recv)(SVCXPRT *, struct rpc_msg *);
+static u_int32_t	wg_xid;
+static int		wg_xid_valid = 0;
+
+static bool_t		wg_recv(SVCXPRT *, struct rpc_msg *);
+
+/*
+ * Enable write gathering. This is not done when several server
+ * processes share the socket, because another process could pick up
+ * the request we're waiting for.
+ */
+void
+wg_init(int gather)
+{
+	wg_enabled = sync_writes && gather;
+}
+
+/*
+ * Remember the xid of every call we receive on a UDP transport.
+ */
+static bool_t
+wg_recv(SVCXPRT *xprt, struct rpc_msg *msg)
+{
+	bool_t	ok;
+
+	ok = wg_udp_recv(xprt, msg);
+	if (ok) {
+		wg_xid = msg->rm_xid;
+		wg_xid_valid = 1;
+	} else {
+		wg_xid_valid = 0;
+		wg_flush();
+	}
+	return ok;
+}
+
+/*
+ * Install our receive hook on the transport if it is a UDP one.
+ * The ops are shared by all transports of a kind and may be read-only,
+ * so we give the transport our own copy.
+ */
+static void
+wg_hook(SVCXPRT *xprt)
+{
+	int		type;
+	socklen_t	len = sizeof(type);
+
+	if (xprt->xp_ops == &wg_udp_ops
+	 || (const void *) xprt->xp_ops == wg_other_ops)
+		return;
+	if (getsockopt(xprt->xp_sock, SOL_SOCKET, SO_TYPE, &type, &len) < 0
+	 || type != SOCK_DGRAM || wg_udp_recv != NULL) {
+		wg_other_ops = xprt->xp_ops;
+		return;
+	}
+	Dprintf(D_CALL, "enabling write gathering on fd %d\n", xprt->xp_sock);
+	wg_udp_ops = *xprt->xp_ops;
+	wg_udp_recv = wg_udp_ops.xp_recv;
+	wg_udp_ops.xp_recv = wg_recv;
+	xprt->xp_ops = &wg_udp_ops;
+}
+
+/*
+ * Called by the dispatcher for every request before it is processed.
+ * Anything but a WRITE commits the current batch.
+ */
+void
+wg_dispatch(SVCXPRT *xprt, int proc)
+{
+	nfs_reply_deferred = 0;
+	if (!wg_enabled)
+		return;
+	wg_hook(xprt);
+	if (proc != NFSPROC_WRITE)
+		wg_flush();
+}
+
+/*
+ * Encode and send a held back reply.
+ */
+static void
+wg_send(wg_reply *rp)
+{
+	struct rpc_msg	reply;
+	XDR		xdrs;
+	char		buf[256];
+
+	reply.rm_xid = rp->xid;
+	reply.rm_direction = REPLY;
+	reply.rm_reply.rp_stat = MSG_ACCEPTED;
+	reply.acpted_rply.ar_verf = _null_auth;
+	reply.acpted_rply.ar_stat = SUCCESS;
+	reply.acpted_rply.ar_results.where = (caddr_t) &rp->res;
+	reply.acpted_rply.ar_results.proc = (xdrproc_t) xdr_attrstat;
+
+	xdrmem_create(&xdrs, buf, sizeof(buf), XDR_ENCODE);
+	if (!xdr_replymsg(&xdrs, &reply)) {
+		Dprintf(L_ERROR, "unable to encode WRITE reply\n");
+	} else if (sendto(rp->xprt->xp_sock, buf, xdr_getpos(&xdrs), 0,
+			(struct sockaddr *) &rp->addr, sizeof(rp->addr)) < 0) {
+		Dprintf(L_ERROR, "unable to send WRITE reply: %s\n",
+					strerror(errno));
+	}
+	xdr_destroy(&xdrs);
+}
+
+/*
+ * Commit the current batch and send the held back replies. If the
+ * commit fails, they all get an error.
+ */
+void
+wg_flush(void)
+{
+	nfsstat	status = NFS_OK;
+	int	i;
+
+	if (wg_count == 0)
+		return;
+
+	if (efs_fdatasync(wg_fd) < 0)
+		status = nfs_errno();
+	close(wg_fd);
+	wg_fd = -1;
+
+	Dprintf(D_CALL, "committed %d gathered writes, status %d\n",
+				wg_count, status);
+	for (i = 0; i < wg_count; i++) {
+		if (status != NFS_OK)
+			wg_replies[i].res.status = status;
+		wg_send(&wg_replies[i]);
+	}
+	wg_count = 0;
+}
+
+/*
+ * Check whether another request is waiting on the socket.
+ */
+static int
+wg_pending(int sock, int msecs)
+{
+	struct pollfd	pfd;
+
+	pfd.fd = sock;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	return poll(&pfd, 1, msecs) > 0 && (pfd.revents & POLLIN);
+}
+
+/*
+ * Make the WRITE just done to FD stable. RES is the reply, which is
+ * either held back (in which case nfs_reply_deferred is set and the
+ * caller must not send it), or is to be sent once we return.
+ */
+void
+wg_commit(struct svc_req *rqstp, fhcache *fhc, int fd, attrstat *res)
+{
+	SVCXPRT		*xprt = rqstp->rq_xprt;
+	wg_reply	*rp;
+
+	if (!sync_writes)
+		return;
+
+	/* A WRITE to a different file ends the batch */
+	if (wg_count && wg_psi != fhc->h.psi)
+		wg_flush();
+
+	if (wg_enabled && xprt->xp_ops == &wg_udp_ops && wg_xid_valid
+	 && wg_count < WG_MAX
+	 && xprt->xp_verf.oa_flavor == AUTH_NULL) {
+		if (wg_pending(xprt->xp_sock, 0)) {
+			/* Clients are streaming; it's worth waiting */
+			wg_wait = WG_WAIT;
+		} else if (!wg_wait || !wg_pending(xprt->xp_sock, wg_wait)) {
+			/* Waiting didn't pay off; don't do it again
+			 * until a batch forms by itself. */
+			wg_wait = 0;
+			goto commit;
+		}
+		if (wg_count == 0) {
+			if ((wg_fd = dup(fd)) < 0)
+				goto commit;
+			wg_psi = fhc->h.psi;
+		}
+		rp = &wg_replies[wg_count++];
+		rp->xprt = xprt;
+		rp->xid = wg_xid;
+		rp->addr = *svc_getcaller(xprt);
+		rp->res = *res;
+		nfs_reply_deferred = 1;
+		wg_xid_valid = 0;
+		return;
+	}
+
+commit:
+	/* This also commits the writes gathered before */
+	if (efs_fdatasync(fd) < 0)
+		res->status = nfs_errno();
+	if (wg_count) {
+		close(wg_fd);
+		wg_fd = -1;
+		Dprintf(D_CALL, "committed %d gathered writes\n", wg_count + 1);
+		for (rp = wg_replies; rp < wg_replies + wg_count; rp++) {
+			if (res->status != NFS_OK)
+				rp->res.status = res->status;
+			wg_send(rp);
+		}
+		wg_count = 0;
+	}
+}